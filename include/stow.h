@@ -6,13 +6,14 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     TOKEN_VAR, TOKEN_VAL, TOKEN_FUNC, TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE,
-    TOKEN_PRINT, TOKEN_INPUT, TOKEN_RETURN, TOKEN_BREAK, TOKEN_CONTINUE, TOKEN_IMPORT,
+    TOKEN_PRINT, TOKEN_INPUT, TOKEN_RETURN, TOKEN_BREAK, TOKEN_CONTINUE, TOKEN_IMPORT, TOKEN_MEMO, TOKEN_FOR, TOKEN_SPAWN,
     TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
     TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_LBRACE, TOKEN_RBRACE, TOKEN_LBRACKET, TOKEN_RBRACKET,
-    TOKEN_COLON, TOKEN_COMMA, TOKEN_EQUALS, TOKEN_SEMICOLON,
+    TOKEN_COLON, TOKEN_COMMA, TOKEN_EQUALS, TOKEN_SEMICOLON, TOKEN_DOT_DOT,
     TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR, TOKEN_SLASH,
     TOKEN_EQ_EQ, TOKEN_BANG_EQ, TOKEN_LT, TOKEN_GT, TOKEN_AND, TOKEN_OR,
     TOKEN_EOF, TOKEN_UNKNOWN
@@ -20,7 +21,7 @@ typedef enum {
 
 typedef struct {
     TokenType type;
-    char* value;
+    const char* value;
     int line;
 } Token;
 
@@ -39,13 +40,59 @@ Token lexer_peek_token(Lexer* lexer);
 void token_free(Token token);
 
 typedef enum {
-    TYPE_INT, TYPE_STR, TYPE_FLOAT, TYPE_BOOL, TYPE_VOID, TYPE_LIST, TYPE_UNKNOWN
+    TYPE_INT, TYPE_STR, TYPE_FLOAT, TYPE_BOOL, TYPE_VOID, TYPE_LIST, TYPE_MAP, TYPE_UNKNOWN
 } DataType;
 
+const char* intern(const char* s, size_t len);
+const char* intern_cstr(const char* s);
+TokenType intern_keyword(const char* sym);
+DataType intern_type(const char* sym);
+
+typedef struct {
+    uint32_t hash;
+    uint32_t dist; // 0 = empty, otherwise probe distance + 1
+    char* key;
+    char* value;
+} MapSlot;
+
+typedef struct {
+    MapSlot* slots;
+    size_t capacity;
+    size_t count;
+    uint32_t id; // handle slot for Stow values, 0 for internal maps
+    bool marked;
+} Map;
+
+uint32_t map_hash(const char* key);
+Map* map_new(void);
+void map_free(Map* map);
+const char* map_get(Map* map, const char* key);
+void map_set(Map* map, const char* key, const char* value);
+bool map_remove(Map* map, const char* key);
+char* map_keys(Map* map);
+
+// Stow values refer to maps through handles, so passing or copying a map
+// shares it. A handle starts with MAP_HANDLE_MARK, which is stripped from
+// literals and input and never produced by `+`, so scripts can not forge
+// one. Unreachable maps are freed by map_sweep once the interpreter has
+// marked every value it still holds.
+#define MAP_HANDLE_MARK '\x01'
+extern size_t map_live;
+extern size_t map_collect_at;
+Map* map_create(void);
+char* map_handle(Map* map);
+uint32_t map_handle_id(const char* value);
+Map* map_from_value(const char* value);
+const char* map_display(const char* value);
+void strip_handle_marks(char* s);
+void map_mark(const char* value);
+void map_sweep(void);
+
 typedef struct Symbol {
-    char* name;
+    const char* name;
     DataType type;
     char* value;
+    size_t capacity; // bytes allocated for value, reused on reassignment
     bool is_constant;
     struct Symbol* next;
 } Symbol;
@@ -54,14 +101,16 @@ typedef enum {
     NODE_PRINT, NODE_INPUT, NODE_STRING, NODE_NUMBER, NODE_IDENTIFIER,
     NODE_VAR_DECL, NODE_BLOCK, NODE_FUNC_DECL, NODE_FUNC_CALL,
     NODE_IF, NODE_WHILE, NODE_BIN_OP, NODE_LIST, NODE_PARAM, NODE_ASSIGN,
-    NODE_RETURN, NODE_BREAK, NODE_CONTINUE, NODE_IMPORT, NODE_INDEX
+    NODE_RETURN, NODE_BREAK, NODE_CONTINUE, NODE_IMPORT, NODE_INDEX, NODE_MAP, NODE_PAIR, NODE_FOR, NODE_SPAWN,
+    NODE_TYPE_COUNT
 } NodeType;
 
 typedef struct ASTNode {
     NodeType type;
-    char* value;
-    char* var_name;
+    const char* value;
+    const char* var_name;
     DataType var_type;
+    TokenType op;
     int line;
     struct ASTNode* left;
     struct ASTNode* right;
@@ -73,22 +122,236 @@ typedef struct ASTNode {
     struct ASTNode* index;  
 } ASTNode;
 
+typedef struct MemoEntry {
+    uint32_t hash;
+    char* key;
+    char* value;
+    struct MemoEntry* chain;
+    struct MemoEntry* prev;
+    struct MemoEntry* next;
+} MemoEntry;
+
+typedef struct {
+    MemoEntry** buckets;
+    size_t bucket_count;
+    size_t count;
+    size_t capacity;
+    MemoEntry* head; // most recently used
+    MemoEntry* tail;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    int line; // of the declaration, for E015
+    unsigned long generation; // function_generation purity was checked at, 0 = never
+    bool pure;
+} MemoCache;
+
+#define STOW_MEMO_CAPACITY 4096
+
+MemoCache* memo_new(size_t capacity);
+void memo_clear(MemoCache* cache);
+void memo_free(MemoCache* cache);
+const char* memo_get(MemoCache* cache, const char* key);
+void memo_put(MemoCache* cache, const char* key, const char* value);
+char* memo_key(char** args, int argc);
+
 typedef struct Function {
-    char* name;
+    const char* name;
     ASTNode* params;
     ASTNode* body;
+    MemoCache* memo; // NULL unless declared with `memo func`
     struct Function* next;
 } Function;
 
-extern bool should_return;
-extern char* return_value;
-extern bool should_break;
-extern bool should_continue;
+// Non-tail Stow calls still nest C frames. Raise the limit with
+// --max-depth; a call that would run out of native stack first still
+// reports E014 (see task_stack_low).
+#define STOW_DEFAULT_MAX_DEPTH 1000
+
+typedef struct {
+    const char* name;
+    char* value; // NULL if the name was not bound in the task yet
+} SavedLocal;
+
+typedef struct {
+    Function* func;
+    int line;
+    SavedLocal* saved;
+    int saved_count;
+    int saved_capacity;
+} CallFrame;
+
+extern Function* function_table;
+extern unsigned long function_generation; // bumped whenever function_table changes
+extern Symbol* symbol_table;
+
+Symbol* find_symbol(const char* name);
+void set_variable(const char* name, DataType type, const char* value, bool is_const);
+bool snapshot_save(const char* path);
+bool snapshot_load(const char* path);
+
+typedef enum { TASK_RUNNABLE, TASK_BLOCKED, TASK_DONE } TaskState;
+
+// A green task: the interpreter's control flow state plus its own native
+// stack. The main script runs as a task too.
+typedef struct Task {
+    int id;
+    TaskState state;
+    bool should_return;
+    bool should_break;
+    bool should_continue;
+    char* return_value;
+    CallFrame* call_stack;
+    int call_depth;
+    int call_stack_capacity;
+    Symbol* locals; // parameters and locals of every frame, searched before symbol_table
+    // Values only held by C locals while an expression is being evaluated;
+    // the map collector treats them as roots
+    const char** temps;
+    int temp_count;
+    int temp_capacity;
+    // Pending `return f(...)`: arguments are already evaluated, the active
+    // call_with_args loop rebinds them instead of nesting a new call.
+    Function* tail_func;
+    char** tail_args;
+    int tail_argc;
+    Function* entry;
+    char** args;
+    int argc;
+    int line; // spawn line, then the line the task last blocked on
+    void* context;
+    void* stack;
+    size_t stack_size;
+    char* stack_limit; // calls report E014 once the stack reaches it; NULL if unknown
+    struct Task* next; // run queue or channel wait queue
+    struct Task* all_prev; // every spawned task not yet freed
+    struct Task* all_next;
+} Task;
+
+extern Task* current_task;
+extern int task_count; // spawned tasks still alive
+
+void task_spawn(Function* f, char** args, int argc, int line);
+void task_yield(void);
+void task_block(int line);
+void task_wait_input(void);
+void task_wait_all(void);
+void task_run_main(void (*fn)(void));
+bool task_stack_low(void);
+void task_register_natives(void);
+void task_mark_maps(void);
+char* call_with_args(Function* f, char** args, int argc, int line);
+void free_args(char** args, int argc);
+
+extern bool should_abort;
+extern const char* abort_code;
+extern int abort_line;
+extern int max_call_depth;
+
+// Execution budgets for one run; 0 means unlimited
+typedef struct {
+    unsigned long max_steps;
+    size_t max_heap;
+    double max_time_ms;
+} Budget;
+
+extern Budget budget;
+extern unsigned long budget_steps;
+extern unsigned long budget_next_check;
+extern size_t budget_heap_limit;
+extern size_t heap_in_use; // live bytes in variables, values saved by frames, maps and channels
+
+double now_ms(void);
+void budget_start(void);
+void budget_check(int line);
+void budget_reschedule(void);
+
+#define BUDGET_TICK(line) do { \
+    if (++budget_steps >= budget_next_check || heap_in_use > budget_heap_limit) budget_check(line); \
+} while (0)
+
+// Native functions receive their arguments already converted according
+// to their signature string: one character per argument, n = number
+// (anything parse_number rejects reports E022), s = string, m = map (map
+// is set), a = any value (map is set if it is one). Natives are looked up
+// before user functions, so declaring one with a native's name is E026.
+typedef struct {
+    double num;
+    const char* str;
+    Map* map;
+} NativeArg;
+
+typedef char* (*NativeFn)(NativeArg* args);
+extern int native_line; // line of the native call being run, for errors
+
+typedef struct {
+    const char* name;
+    const char* signature;
+    int arity;
+    bool pure; // false for I/O, clocks, tasks and map mutation; memo rejects those
+    NativeFn fn;
+} NativeFunction;
+
+void register_native(const char* name, const char* signature, bool pure, NativeFn fn);
+NativeFunction* find_native(const char* name);
+char* format_number(double v);
+bool parse_number(const char* s, double* out);
 
 void report_error(const char* code, int line);
+void runtime_abort(const char* code, int line);
 ASTNode* parse(Lexer* lexer);
 void interpret(ASTNode* node);
 void free_ast(ASTNode* node);
 char* read_file(const char* filename);
 
+// Runtime counters for --stats. Only `make stats` builds define STOW_STATS;
+// otherwise every STAT_* macro expands to nothing.
+#ifdef STOW_STATS
+typedef struct {
+    double parse_ms;
+    double run_ms;
+    unsigned long mallocs;
+    unsigned long frees;
+    unsigned long bytes_allocated;
+    unsigned long bytes_freed;
+    unsigned long bytes_live;
+    unsigned long bytes_peak;
+    unsigned long tokens;
+    unsigned long ast_nodes;
+    unsigned long symbol_lookups;
+    unsigned long symbol_steps;
+    unsigned long function_lookups;
+    unsigned long function_steps;
+    unsigned long node_evals[NODE_TYPE_COUNT];
+} Stats;
+
+extern Stats stats;
+
+void* stats_malloc(size_t size);
+void* stats_calloc(size_t count, size_t size);
+void* stats_realloc(void* ptr, size_t size);
+void stats_free(void* ptr);
+char* stats_strdup(const char* s);
+void stats_report(FILE* out);
+
+#define STAT_INC(field) (stats.field++)
+#define STAT_NODE(type) (stats.node_evals[(type)]++)
+#define STAT_TIMER_START(t) double t = now_ms()
+#define STAT_TIMER_STOP(field, t) (stats.field += now_ms() - (t))
+
+#ifndef STOW_STATS_IMPL
+#undef strdup
+#define malloc(n) stats_malloc(n)
+#define calloc(c, n) stats_calloc(c, n)
+#define realloc(p, n) stats_realloc(p, n)
+#define free(p) stats_free(p)
+#define strdup(s) stats_strdup(s)
+#endif
+#else
+#define STAT_INC(field) ((void)0)
+#define STAT_NODE(type) ((void)0)
+#define STAT_TIMER_START(t) ((void)0)
+#define STAT_TIMER_STOP(field, t) ((void)0)
+#endif
+
 #endif
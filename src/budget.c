@@ -0,0 +1,53 @@
+#include "stow.h"
+#include <limits.h>
+#include <time.h>
+
+// Per-run execution limits. BUDGET_TICK runs only at loop back-edges and
+// function calls: one increment and two compares on the hot path, with
+// the clock read at most once every BUDGET_CLOCK_INTERVAL steps.
+
+#define BUDGET_CLOCK_INTERVAL 1024
+
+Budget budget = {0, 0, 0};
+unsigned long budget_steps = 0;
+unsigned long budget_next_check = ULONG_MAX;
+size_t budget_heap_limit = SIZE_MAX;
+size_t heap_in_use = 0;
+static double budget_deadline = 0;
+
+double now_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// While tasks are alive the check also ends the running task's time slice
+#define TASK_SLICE 256
+
+void budget_reschedule(void) {
+    unsigned long next = ULONG_MAX;
+    if (budget.max_time_ms) next = budget_steps + BUDGET_CLOCK_INTERVAL;
+    if (task_count && budget_steps + TASK_SLICE < next) next = budget_steps + TASK_SLICE;
+    if (budget.max_steps && budget.max_steps < next) next = budget.max_steps;
+    budget_next_check = next;
+}
+
+void budget_start(void) {
+    budget_steps = 0;
+    budget_deadline = budget.max_time_ms ? now_ms() + budget.max_time_ms : 0;
+    budget_heap_limit = budget.max_heap ? heap_in_use + budget.max_heap : SIZE_MAX;
+    budget_reschedule();
+}
+
+void budget_check(int line) {
+    if (should_abort) return;
+    if (budget.max_steps && budget_steps >= budget.max_steps) {
+        runtime_abort("E016", line);
+    } else if (heap_in_use > budget_heap_limit) {
+        runtime_abort("E017", line);
+    } else if (budget_deadline && now_ms() > budget_deadline) {
+        runtime_abort("E018", line);
+    }
+    budget_reschedule();
+    if (task_count && !should_abort) task_yield();
+}
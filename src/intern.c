@@ -0,0 +1,105 @@
+#include "stow.h"
+#include <stddef.h>
+
+// Every identifier and literal is stored exactly once; equal names share
+// the same pointer, so comparing two symbols is a single pointer compare.
+typedef struct InternEntry {
+    uint32_t hash;
+    uint32_t len;
+    TokenType keyword;
+    DataType type_name;
+    char str[];
+} InternEntry;
+
+static InternEntry** intern_slots = NULL;
+static size_t intern_capacity = 0;
+static size_t intern_count = 0;
+
+static uint32_t intern_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static InternEntry* intern_entry(const char* sym) {
+    return (InternEntry*)(sym - offsetof(InternEntry, str));
+}
+
+static void intern_grow(void) {
+    size_t new_cap = intern_capacity ? intern_capacity * 2 : 256;
+    InternEntry** slots = calloc(new_cap, sizeof(InternEntry*));
+    for (size_t i = 0; i < intern_capacity; i++) {
+        InternEntry* e = intern_slots[i];
+        if (!e) continue;
+        size_t j = e->hash & (new_cap - 1);
+        while (slots[j]) j = (j + 1) & (new_cap - 1);
+        slots[j] = e;
+    }
+    free(intern_slots);
+    intern_slots = slots;
+    intern_capacity = new_cap;
+}
+
+static const char* intern_raw(const char* s, size_t len) {
+    if ((intern_count + 1) * 4 > intern_capacity * 3) intern_grow();
+    uint32_t h = intern_hash(s, len);
+    size_t i = h & (intern_capacity - 1);
+    while (intern_slots[i]) {
+        InternEntry* e = intern_slots[i];
+        if (e->hash == h && e->len == len && memcmp(e->str, s, len) == 0) return e->str;
+        i = (i + 1) & (intern_capacity - 1);
+    }
+    InternEntry* e = malloc(sizeof(InternEntry) + len + 1);
+    e->hash = h;
+    e->len = (uint32_t)len;
+    e->keyword = TOKEN_IDENTIFIER;
+    e->type_name = TYPE_UNKNOWN;
+    memcpy(e->str, s, len);
+    e->str[len] = '\0';
+    intern_slots[i] = e;
+    intern_count++;
+    return e->str;
+}
+
+static void intern_init(void) {
+    static const struct { const char* name; TokenType type; } keywords[] = {
+        {"print", TOKEN_PRINT}, {"input", TOKEN_INPUT}, {"var", TOKEN_VAR},
+        {"val", TOKEN_VAL}, {"func", TOKEN_FUNC}, {"if", TOKEN_IF},
+        {"else", TOKEN_ELSE}, {"while", TOKEN_WHILE}, {"return", TOKEN_RETURN},
+        {"break", TOKEN_BREAK}, {"continue", TOKEN_CONTINUE}, {"import", TOKEN_IMPORT},
+        {"memo", TOKEN_MEMO}, {"for", TOKEN_FOR}, {"spawn", TOKEN_SPAWN},
+    };
+    static const struct { const char* name; DataType type; } types[] = {
+        {"Int", TYPE_INT}, {"Str", TYPE_STR}, {"Float", TYPE_FLOAT},
+        {"Bool", TYPE_BOOL}, {"Void", TYPE_VOID}, {"List", TYPE_LIST},
+        {"Map", TYPE_MAP},
+    };
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        const char* sym = intern_raw(keywords[i].name, strlen(keywords[i].name));
+        intern_entry(sym)->keyword = keywords[i].type;
+    }
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        const char* sym = intern_raw(types[i].name, strlen(types[i].name));
+        intern_entry(sym)->type_name = types[i].type;
+    }
+}
+
+const char* intern(const char* s, size_t len) {
+    if (!intern_slots) intern_init();
+    return intern_raw(s, len);
+}
+
+const char* intern_cstr(const char* s) {
+    return intern(s, strlen(s));
+}
+
+TokenType intern_keyword(const char* sym) {
+    return sym ? intern_entry(sym)->keyword : TOKEN_IDENTIFIER;
+}
+
+DataType intern_type(const char* sym) {
+    return sym ? intern_entry(sym)->type_name : TYPE_UNKNOWN;
+}
@@ -20,89 +20,482 @@ char* read_file(const char* filename) {
 
 Symbol* symbol_table = NULL;
 Function* function_table = NULL;
+unsigned long function_generation = 1;
 
-bool should_return = false;
-char* return_value = NULL;
-bool should_break = false;
-bool should_continue = false;
+// Control flow state lives in current_task (see task.c); an abort stops
+// every task.
+bool should_abort = false;
+const char* abort_code = NULL;
+int abort_line = 0;
+int max_call_depth = STOW_DEFAULT_MAX_DEPTH;
 
-void set_variable(const char* name, DataType type, const char* value, bool is_const) {
-    Symbol* current = symbol_table;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            free(current->value);
-            current->value = strdup(value);
-            return;
-        }
-        current = current->next;
+Symbol* find_in(Symbol* list, const char* name) {
+    for (Symbol* current = list; current; current = current->next) {
+        STAT_INC(symbol_steps);
+        if (current->name == name) return current;
     }
+    return NULL;
+}
+
+// The running task's parameters and locals shadow the globals
+Symbol* find_symbol(const char* name) {
+    STAT_INC(symbol_lookups);
+    Symbol* local = find_in(current_task->locals, name);
+    return local ? local : find_in(symbol_table, name);
+}
+
+// heap_in_use counts a symbol by its buffer's capacity; every resize
+// moves it by the difference.
+void symbol_resize(Symbol* sym, size_t size) {
+    heap_in_use += size;
+    heap_in_use -= sym->capacity;
+    free(sym->value);
+    sym->value = malloc(size);
+    sym->value[0] = '\0';
+    sym->capacity = size;
+}
+
+// Grows the value buffer only when needed, so loops that keep
+// reassigning a variable do not allocate on every store.
+void symbol_reserve(Symbol* sym, size_t size) {
+    if (size > sym->capacity) symbol_resize(sym, size);
+}
+
+// Buffers below this are never shrunk
+#define SYMBOL_SHRINK_MIN 256
+
+void symbol_store(Symbol* sym, const char* value) {
+    size_t len = strlen(value) + 1;
+    // A buffer four times larger than its value is shrunk, so a variable
+    // that once held a large value does not keep it charged to --max-heap
+    if (len > sym->capacity || (sym->capacity > SYMBOL_SHRINK_MIN && len < sym->capacity / 4)) {
+        char* copy = strdup(value); // value may alias the old buffer
+        symbol_resize(sym, len);
+        memcpy(sym->value, copy, len);
+        free(copy);
+    } else {
+        memmove(sym->value, value, len);
+    }
+}
+
+void symbol_push(Symbol** list, const char* name, DataType type, const char* value, bool is_const) {
     Symbol* new_sym = malloc(sizeof(Symbol));
-    new_sym->name = strdup(name);
+    new_sym->name = name;
     new_sym->type = type;
     new_sym->value = strdup(value);
+    new_sym->capacity = strlen(value) + 1;
+    heap_in_use += new_sym->capacity;
     new_sym->is_constant = is_const;
-    new_sym->next = symbol_table;
-    symbol_table = new_sym;
+    new_sym->next = *list;
+    *list = new_sym;
+}
+
+void set_variable(const char* name, DataType type, const char* value, bool is_const) {
+    Symbol* current = find_symbol(name);
+    if (current) symbol_store(current, value);
+    else symbol_push(&symbol_table, name, type, value, is_const);
 }
 
 char* get_variable_value(const char* name) {
-    Symbol* current = symbol_table;
-    while (current) {
-        if (strcmp(current->name, name) == 0) return current->value;
-        current = current->next;
+    Symbol* sym = find_symbol(name);
+    return sym ? sym->value : NULL;
+}
+
+char* evaluate_node(ASTNode* node);
+void interpret_node(ASTNode* node);
+
+// Keeps a map handle alive while it is only held in a C local. Callers
+// save current_task->temp_count and restore it once the value is stored.
+void hold_value(const char* value) {
+    if (value[0] != MAP_HANDLE_MARK) return;
+    Task* t = current_task;
+    if (t->temp_count == t->temp_capacity) {
+        t->temp_capacity = t->temp_capacity ? t->temp_capacity * 2 : 16;
+        t->temps = realloc(t->temps, t->temp_capacity * sizeof(char*));
+    }
+    t->temps[t->temp_count++] = value;
+}
+
+// A map literal evaluates to the handle of a new map
+char* evaluate_map(ASTNode* literal) {
+    Map* map = map_create();
+    char* handle = map_handle(map);
+    int temps = current_task->temp_count;
+    hold_value(handle);
+    for (ASTNode* pair = literal->params; pair; pair = pair->next_param) {
+        char* key = evaluate_node(pair->index);
+        hold_value(key);
+        char* val = evaluate_node(pair->left);
+        map_set(map, key, val);
+        free(key); free(val);
+        current_task->temp_count = temps + 1;
+    }
+    current_task->temp_count = temps;
+    return handle;
+}
+
+bool is_list_variable(const char* name) {
+    Symbol* sym = find_symbol(name);
+    return sym && strcmp(sym->value, "[Lista]") == 0;
+}
+
+// Lists are still placeholders, indexing one is not an error
+Map* get_map(ASTNode* node) {
+    Symbol* sym = find_symbol(node->value);
+    if (!sym) { report_error("E007", node->line); return NULL; }
+    Map* map = map_from_value(sym->value);
+    if (!map && !is_list_variable(node->value)) report_error("E013", node->line);
+    return map;
+}
+
+// Runs between statements at any depth. The roots are the globals, memo
+// caches, channel buffers and, for every task, its bindings, the values
+// its frames shadow, pending arguments and held temporaries.
+void collect_maps(void) {
+    for (Symbol* s = symbol_table; s; s = s->next) map_mark(s->value);
+    for (Function* f = function_table; f; f = f->next) {
+        for (MemoEntry* e = f->memo ? f->memo->head : NULL; e; e = e->next) map_mark(e->value);
+    }
+    task_mark_maps();
+    map_sweep();
+}
+
+// Evaluates the arguments according to the native's signature:
+// n = number, s = string, m = map, a = any value
+char* call_native(NativeFunction* nf, ASTNode* node) {
+    int argc = 0;
+    for (ASTNode* a = node->params; a; a = a->next_param) argc++;
+    if (argc != nf->arity) { report_error("E011", node->line); return strdup(""); }
+
+    NativeArg* args = calloc(argc ? argc : 1, sizeof(NativeArg));
+    bool ok = true;
+    int temps = current_task->temp_count;
+    ASTNode* arg = node->params;
+    for (int i = 0; i < argc && ok; i++, arg = arg->next_param) {
+        char kind = nf->signature[i];
+        args[i].str = evaluate_node(arg);
+        hold_value(args[i].str);
+        if (kind == 'n') {
+            if (!parse_number(args[i].str, &args[i].num)) {
+                report_error("E022", arg->line);
+                ok = false;
+            }
+        } else if (kind == 'm' || kind == 'a') {
+            args[i].map = map_from_value(args[i].str);
+            if (kind == 'm' && !args[i].map) {
+                report_error("E013", arg->line);
+                ok = false;
+            }
+        }
+    }
+    native_line = node->line;
+    char* res = ok && !should_abort ? nf->fn(args) : strdup("");
+    current_task->temp_count = temps;
+    for (int i = 0; i < argc; i++) free((char*)args[i].str);
+    free(args);
+    return res;
+}
+
+Function* find_function(const char* name) {
+    STAT_INC(function_lookups);
+    for (Function* f = function_table; f; f = f->next) {
+        STAT_INC(function_steps);
+        if (f->name == name) return f;
     }
     return NULL;
 }
 
-char* evaluate_node(ASTNode* node);
+char** evaluate_args(ASTNode* arg, int* argc) {
+    int n = 0;
+    for (ASTNode* a = arg; a; a = a->next_param) n++;
+    char** args = malloc((n ? n : 1) * sizeof(char*));
+    int temps = current_task->temp_count;
+    for (int i = 0; i < n; i++, arg = arg->next_param) {
+        args[i] = evaluate_node(arg);
+        hold_value(args[i]);
+    }
+    current_task->temp_count = temps;
+    *argc = n;
+    return args;
+}
 
-void interpret_node(ASTNode* node) {
-    if (!node || should_return || should_break || should_continue) return;
+void free_args(char** args, int argc) {
+    for (int i = 0; i < argc; i++) free(args[i]);
+    free(args);
+}
+
+// Parameters and locals live in the task's own bindings, never in
+// symbol_table. The frame remembers, once per name, the binding it
+// shadowed in the task so the caller sees its own value again once the
+// call returns; switching tasks only changes current_task.
+void frame_save(CallFrame* frame, const char* name) {
+    for (int j = 0; j < frame->saved_count; j++) {
+        if (frame->saved[j].name == name) return;
+    }
+    if (frame->saved_count == frame->saved_capacity) {
+        frame->saved_capacity = frame->saved_capacity ? frame->saved_capacity * 2 : 4;
+        frame->saved = realloc(frame->saved, frame->saved_capacity * sizeof(SavedLocal));
+    }
+    Symbol* old = find_in(current_task->locals, name);
+    if (old) heap_in_use += strlen(old->value) + 1;
+    frame->saved[frame->saved_count++] = (SavedLocal){name, old ? strdup(old->value) : NULL};
+}
+
+// Binds name in the innermost frame of the running task
+void bind_local(const char* name, DataType type, const char* value, bool is_const) {
+    Task* t = current_task;
+    frame_save(&t->call_stack[t->call_depth - 1], name);
+    Symbol* sym = find_in(t->locals, name);
+    if (sym) symbol_store(sym, value);
+    else symbol_push(&t->locals, name, type, value, is_const);
+}
+
+// `var`/`val` and `for` at top level declare globals, inside a function
+// they declare locals
+void declare_variable(const char* name, DataType type, const char* value, bool is_const) {
+    if (current_task->call_depth > 0) bind_local(name, type, value, is_const);
+    else set_variable(name, type, value, is_const);
+}
+
+void bind_params(Function* f, char** args, int argc) {
+    int i = 0;
+    for (ASTNode* p = f->params; p && i < argc; p = p->next_param, i++) {
+        bind_local(p->value, p->var_type, args[i], false);
+    }
+}
+
+void restore_locals(CallFrame* frame) {
+    Task* t = current_task;
+    for (int j = frame->saved_count - 1; j >= 0; j--) {
+        SavedLocal* saved = &frame->saved[j];
+        Symbol** link = &t->locals;
+        while ((*link)->name != saved->name) link = &(*link)->next;
+        if (saved->value) {
+            symbol_store(*link, saved->value);
+            heap_in_use -= strlen(saved->value) + 1;
+            free(saved->value);
+        } else {
+            Symbol* dead = *link;
+            *link = dead->next;
+            heap_in_use -= dead->capacity;
+            free(dead->value);
+            free(dead);
+        }
+    }
+    free(frame->saved);
+}
+
+bool declares_local(ASTNode* node, const char* name) {
+    if (!node) return false;
+    if ((node->type == NODE_VAR_DECL || node->type == NODE_FOR) && node->var_name == name) return true;
+    if (node->type == NODE_FUNC_DECL) return declares_local(node->right, name);
+    return declares_local(node->left, name) || declares_local(node->right, name) ||
+           declares_local(node->body, name) || declares_local(node->else_body, name);
+}
+
+bool is_local(Function* func, const char* name) {
+    for (ASTNode* p = func->params; p; p = p->next_param) {
+        if (p->value == name) return true;
+    }
+    return declares_local(func->body, name);
+}
+
+// Functions already checked (or being checked) by one purity check
+typedef struct {
+    Function** items;
+    int count;
+    int capacity;
+} FunctionSet;
+
+bool function_set_add(FunctionSet* set, Function* f) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->items[i] == f) return false;
+    }
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 8;
+        set->items = realloc(set->items, set->capacity * sizeof(Function*));
+    }
+    set->items[set->count++] = f;
+    return true;
+}
+
+// A memoized function, and every function it calls, may not do I/O, call
+// an impure native, write anything but its own parameters and locals, or
+// read globals other than `val` constants. Maps are shared, so indexing
+// one counts as a read of the variable holding it.
+bool is_pure_node(ASTNode* node, Function* func, FunctionSet* seen) {
+    if (!node) return true;
+    if (node->type == NODE_PRINT || node->type == NODE_INPUT || node->type == NODE_IMPORT ||
+        node->type == NODE_SPAWN || node->type == NODE_FUNC_DECL) return false;
+    if (node->type == NODE_ASSIGN && (node->index || !is_local(func, node->value))) return false;
+    if ((node->type == NODE_IDENTIFIER || node->type == NODE_INDEX) && !is_local(func, node->value)) {
+        Symbol* sym = find_symbol(node->value);
+        if (!sym || !sym->is_constant || map_handle_id(sym->value)) return false;
+    }
+    if (node->type == NODE_FUNC_CALL) {
+        NativeFunction* nf = find_native(node->value);
+        Function* callee = nf ? NULL : find_function(node->value);
+        if (nf ? !nf->pure : !callee) return false;
+        if (callee && function_set_add(seen, callee) && !is_pure_node(callee->body, callee, seen)) return false;
+    }
+    return is_pure_node(node->left, func, seen) && is_pure_node(node->right, func, seen) &&
+           is_pure_node(node->condition, func, seen) && is_pure_node(node->body, func, seen) &&
+           is_pure_node(node->else_body, func, seen) && is_pure_node(node->params, func, seen) &&
+           is_pure_node(node->next_param, func, seen) && is_pure_node(node->index, func, seen);
+}
+
+// Checked on the first call, once the functions it calls are declared,
+// and again after function_table changes, since a callee may have been
+// redeclared; results cached under the old definitions are dropped. An
+// impure function reports E015 and runs without the cache.
+void verify_memo(Function* f) {
+    FunctionSet seen = {NULL, 0, 0};
+    function_set_add(&seen, f);
+    bool pure = is_pure_node(f->body, f, &seen);
+    free(seen.items);
+    memo_clear(f->memo);
+    f->memo->generation = function_generation;
+    if (!pure && f->memo->pure) report_error("E015", f->memo->line);
+    f->memo->pure = pure;
+}
+
+// Map arguments are compared by handle while their contents can change
+bool has_map_arg(char** args, int argc) {
+    for (int i = 0; i < argc; i++) {
+        if (map_handle_id(args[i])) return true;
+    }
+    return false;
+}
+
+char* call_function(ASTNode* node) {
+    Function* f = find_function(node->value);
+    if (!f || should_abort) return strdup("void");
+    int argc;
+    char** args = evaluate_args(node->params, &argc);
+    return call_with_args(f, args, argc, node->line);
+}
+
+// Runs f with already evaluated arguments, taking ownership of args
+char* call_with_args(Function* f, char** args, int argc, int line) {
+    Task* t = current_task; // a task always resumes as itself
+    if (t->call_depth >= max_call_depth || task_stack_low()) {
+        runtime_abort("E014", line);
+        free_args(args, argc);
+        return strdup("");
+    }
+    // The tick may switch tasks; args stay roots until they are bound
+    int temps = t->temp_count;
+    for (int i = 0; i < argc; i++) hold_value(args[i]);
+    BUDGET_TICK(line);
+    if (f->memo && f->memo->generation != function_generation) verify_memo(f);
+    MemoCache* memo = f->memo && f->memo->pure && !has_map_arg(args, argc) ? f->memo : NULL;
+    unsigned long generation = function_generation;
+    char* key = NULL;
+    if (memo) {
+        key = memo_key(args, argc);
+        const char* cached = memo_get(memo, key);
+        if (cached) {
+            t->temp_count = temps;
+            free(key);
+            free_args(args, argc);
+            return strdup(cached);
+        }
+    }
+    if (t->call_depth == t->call_stack_capacity) {
+        t->call_stack_capacity = t->call_stack_capacity ? t->call_stack_capacity * 2 : 64;
+        t->call_stack = realloc(t->call_stack, t->call_stack_capacity * sizeof(CallFrame));
+    }
+    int idx = t->call_depth++;
+    t->call_stack[idx] = (CallFrame){f, line, NULL, 0, 0};
+    bind_params(f, args, argc);
+    t->temp_count = temps;
+    free_args(args, argc);
+
+    while (true) {
+        interpret_node(f->body);
+        t->should_return = false;
+        if (!t->tail_func) break;
+        BUDGET_TICK(line);
+        f = t->tail_func;
+        t->tail_func = NULL;
+        t->call_stack[idx].func = f;
+        if (!should_abort) bind_params(f, t->tail_args, t->tail_argc);
+        free_args(t->tail_args, t->tail_argc);
+        t->tail_args = NULL;
+        if (should_abort) break;
+    }
+
+    char* res = t->return_value ? t->return_value : strdup("void");
+    t->return_value = NULL;
+    restore_locals(&t->call_stack[idx]);
+    t->call_depth--;
+    if (memo) {
+        // Not cached if a function was redeclared while it ran
+        if (!should_abort && function_generation == generation) memo_put(memo, key, res);
+        free(key);
+    }
+    return res;
+}
+
+void interpret_statement(ASTNode* node) {
+    STAT_NODE(node->type);
 
     if (node->type == NODE_BLOCK) {
         interpret_node(node->body);
     } else if (node->type == NODE_PRINT) {
         char* val = evaluate_node(node->left);
-        printf("%s\n", val); free(val);
+        if (!should_abort) printf("%s\n", map_display(val));
+        free(val);
     } else if (node->type == NODE_VAR_DECL) {
         char* val = evaluate_node(node->left);
-        set_variable(node->var_name, node->var_type, val, strcmp(node->value, "val") == 0);
+        declare_variable(node->var_name, node->var_type, val, node->op == TOKEN_VAL);
         free(val);
     } else if (node->type == NODE_FUNC_DECL) {
+        // Calls look up natives first, so the declaration could never run
+        if (find_native(node->value)) { report_error("E026", node->line); return; }
         Function* nf = malloc(sizeof(Function));
-        nf->name = strdup(node->value);
+        nf->name = node->value;
         nf->params = node->params;
         nf->body = node->body;
+        nf->memo = NULL;
+        if (node->op == TOKEN_MEMO) {
+            nf->memo = memo_new(STOW_MEMO_CAPACITY);
+            nf->memo->line = node->line;
+        }
         nf->next = function_table;
         function_table = nf;
+        function_generation++;
     } else if (node->type == NODE_FUNC_CALL) {
-        Function* f = function_table;
-        while (f) {
-            if (strcmp(f->name, node->value) == 0) {
-                // Set parameters as global variables (simple version)
-                ASTNode* p = f->params;
-                ASTNode* arg = node->params;
-                while (p && arg) {
-                    char* val = evaluate_node(arg);
-                    set_variable(p->value, p->var_type, val, false);
-                    free(val);
-                    p = p->next_param;
-                    arg = arg->next_param;
-                }
-                interpret_node(f->body);
-                should_return = false; // Reset for next call
-                break;
-            }
-            f = f->next;
-        }
+        NativeFunction* nf = find_native(node->value);
+        free(nf ? call_native(nf, node) : call_function(node));
+    } else if (node->type == NODE_SPAWN) {
+        // Arguments are evaluated by the spawner, the call runs in a new task
+        ASTNode* call = node->left;
+        Function* f = call && call->type == NODE_FUNC_CALL ? find_function(call->value) : NULL;
+        if (!f) { report_error("E010", node->line); return; }
+        int argc;
+        char** args = evaluate_args(call->params, &argc);
+        if (should_abort) free_args(args, argc);
+        else task_spawn(f, args, argc, node->line);
     } else if (node->type == NODE_RETURN) {
-        if (node->left) return_value = evaluate_node(node->left);
-        else return_value = strdup("void");
-        should_return = true;
+        ASTNode* call = node->left;
+        Function* tf = NULL;
+        if (call && call->type == NODE_FUNC_CALL && current_task->call_depth > 0 && !find_native(call->value)) {
+            tf = find_function(call->value);
+        }
+        if (tf) {
+            current_task->tail_args = evaluate_args(call->params, &current_task->tail_argc);
+            current_task->tail_func = tf;
+        } else if (call) {
+            current_task->return_value = evaluate_node(call);
+        } else {
+            current_task->return_value = strdup("void");
+        }
+        current_task->should_return = true;
     } else if (node->type == NODE_BREAK) {
-        should_break = true;
+        current_task->should_break = true;
     } else if (node->type == NODE_CONTINUE) {
-        should_continue = true;
+        current_task->should_continue = true;
     } else if (node->type == NODE_IF) {
         char* cond = evaluate_node(node->condition);
         if (strcmp(cond, "true") == 0 || (atof(cond) != 0)) {
@@ -117,18 +510,55 @@ void interpret_node(ASTNode* node) {
             if (strcmp(cond, "true") == 0 || (atof(cond) != 0)) {
                 free(cond);
                 interpret_node(node->body);
-                if (should_break) { should_break = false; break; }
-                if (should_continue) { should_continue = false; continue; }
-                if (should_return) break;
+                BUDGET_TICK(node->line);
+                if (current_task->should_break) { current_task->should_break = false; break; }
+                if (current_task->should_continue) { current_task->should_continue = false; continue; }
+                if (current_task->should_return || should_abort) break;
             } else {
                 free(cond); break;
             }
         }
+    } else if (node->type == NODE_FOR) {
+        // Bounds are evaluated once; the counter lives in a native integer
+        // and is only formatted into the variable's own buffer.
+        ASTNode* parts[3] = {node->left, node->condition, node->index};
+        double bounds[3] = {0, 0, 1};
+        for (int k = 0; k < 3; k++) {
+            if (k == 2 && !parts[k]) break;
+            char* v = evaluate_node(parts[k]);
+            bool ok = parse_number(v, &bounds[k]);
+            free(v);
+            if (should_abort) return;
+            if (!ok) { report_error("E025", parts[k] ? parts[k]->line : node->line); return; }
+        }
+        long long i = (long long)bounds[0];
+        long long end = (long long)bounds[1];
+        long long step = (long long)bounds[2];
+        if (step == 0) { report_error("E023", node->line); return; }
+
+        declare_variable(node->var_name, TYPE_INT, "", false);
+        Symbol* slot = find_symbol(node->var_name);
+        for (; step > 0 ? i < end : i > end; i += step) {
+            symbol_reserve(slot, 24);
+            snprintf(slot->value, slot->capacity, "%lld", i);
+            interpret_node(node->body);
+            BUDGET_TICK(node->line);
+            if (current_task->should_break) { current_task->should_break = false; break; }
+            if (current_task->should_continue) { current_task->should_continue = false; continue; }
+            if (current_task->should_return || should_abort) break;
+        }
     } else if (node->type == NODE_ASSIGN) {
         char* val = evaluate_node(node->left);
         if (node->index) {
-            // Indexing assignment: mi_lista[i] = val
-            // Not implemented in this simple string-storage version
+            // Indexing assignment: mi_mapa[k] = val. The key is evaluated
+            // first, so a collection it triggers can not free the map.
+            int temps = current_task->temp_count;
+            hold_value(val);
+            char* key = evaluate_node(node->index);
+            current_task->temp_count = temps;
+            Map* map = get_map(node);
+            if (map) map_set(map, key, val);
+            free(key);
         } else {
             set_variable(node->value, TYPE_UNKNOWN, val, false);
         }
@@ -139,20 +569,65 @@ void interpret_node(ASTNode* node) {
             Lexer l; lexer_init(&l, src);
             ASTNode* root = parse(&l);
             if (root) {
-                interpret(root);
-                free_ast(root);
+                Function* before = function_table;
+                interpret_node(root);
+                // Functions declared by the import keep pointing into its tree
+                if (function_table == before) free_ast(root);
             }
             free(src);
         } else {
             fprintf(stderr, "Error: No se pudo importar '%s'\n", node->value);
         }
     }
+}
+
+// Statement lists are walked iteratively so long scripts do not nest C frames
+void interpret_node(ASTNode* node) {
+    for (; node; node = node->right) {
+        Task* t = current_task;
+        if (t->should_return || t->should_break || t->should_continue || should_abort) return;
+        if (map_live >= map_collect_at) collect_maps();
+        interpret_statement(node);
+    }
+}
 
-    if (node->right) interpret_node(node->right);
+// Accepts what Stow writes as a number: an optional '-', digits, an
+// optional fraction and the exponent format_number may add. Unlike bare
+// strtod, "inf", "nan", hex and leading spaces are not numbers.
+bool parse_number(const char* s, double* out) {
+    const char* p = s;
+    if (*p == '-') p++;
+    if (!isdigit((unsigned char)*p)) return false;
+    while (isdigit((unsigned char)*p)) p++;
+    if (*p == '.') {
+        p++;
+        while (isdigit((unsigned char)*p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (!isdigit((unsigned char)*p)) return false;
+        while (isdigit((unsigned char)*p)) p++;
+    }
+    if (*p) return false;
+    *out = strtod(s, NULL);
+    return true;
+}
+
+bool starts_number(const char* s) {
+    return isdigit((unsigned char)s[0]) || (s[0] == '-' && isdigit((unsigned char)s[1]));
+}
+
+// Kept out of evaluate_node so its frame stays small for deep recursion
+char* format_number(double v) {
+    char* res = malloc(32);
+    snprintf(res, 32, "%g", v);
+    return res;
 }
 
 char* evaluate_node(ASTNode* node) {
     if (!node) return strdup("");
+    STAT_NODE(node->type);
     if (node->type == NODE_STRING || node->type == NODE_NUMBER) return strdup(node->value);
     if (node->type == NODE_IDENTIFIER) {
         char* v = get_variable_value(node->value);
@@ -160,71 +635,91 @@ char* evaluate_node(ASTNode* node) {
         return strdup(v);
     }
     if (node->type == NODE_FUNC_CALL) {
-        Function* f = function_table;
-        while (f) {
-            if (strcmp(f->name, node->value) == 0) {
-                // Set parameters as global variables (simple version)
-                ASTNode* p = f->params;
-                ASTNode* arg = node->params;
-                while (p && arg) {
-                    char* val = evaluate_node(arg);
-                    set_variable(p->value, p->var_type, val, false);
-                    free(val);
-                    p = p->next_param;
-                    arg = arg->next_param;
-                }
-                interpret_node(f->body);
-                char* res = return_value ? strdup(return_value) : strdup("void");
-                if (return_value) { free(return_value); return_value = NULL; }
-                should_return = false; // Reset for next call
-                return res;
-            }
-            f = f->next;
-        }
-        return strdup("void");
+        NativeFunction* nf = find_native(node->value);
+        return nf ? call_native(nf, node) : call_function(node);
     }
     if (node->type == NODE_INPUT) {
         char* prompt = evaluate_node(node->left);
         printf("%s", prompt); free(prompt);
-        char buf[1024];
-        if (fgets(buf, sizeof(buf), stdin)) {
+        task_wait_input();
+        char* buf = malloc(1024);
+        if (fgets(buf, 1024, stdin)) {
             buf[strcspn(buf, "\n")] = 0;
-            return strdup(buf);
+            strip_handle_marks(buf);
+            return buf;
         }
-        return strdup("");
+        buf[0] = '\0';
+        return buf;
     }
     if (node->type == NODE_BIN_OP) {
+        int temps = current_task->temp_count;
         char* l = evaluate_node(node->left);
+        hold_value(l);
         char* r = evaluate_node(node->right);
+        current_task->temp_count = temps;
         double lv = atof(l), rv = atof(r);
         char* res = NULL;
-        if (strcmp(node->value, "+") == 0) {
-            if (isdigit(l[0]) && isdigit(r[0])) {
-                char b[64]; sprintf(b, "%g", lv + rv); res = strdup(b);
-            } else {
-                res = malloc(strlen(l) + strlen(r) + 1);
-                strcpy(res, l); strcat(res, r);
-            }
-        } else if (strcmp(node->value, "-") == 0) { char b[64]; sprintf(b, "%g", lv - rv); res = strdup(b); }
-        else if (strcmp(node->value, "*") == 0) { char b[64]; sprintf(b, "%g", lv * rv); res = strdup(b); }
-        else if (strcmp(node->value, "/") == 0) { char b[64]; sprintf(b, "%g", rv != 0 ? lv / rv : 0); res = strdup(b); }
-        else if (strcmp(node->value, "==") == 0) res = strdup(strcmp(l, r) == 0 ? "true" : "false");
-        else if (strcmp(node->value, "!=") == 0) res = strdup(strcmp(l, r) != 0 ? "true" : "false");
-        else if (strcmp(node->value, "<") == 0) res = strdup(lv < rv ? "true" : "false");
-        else if (strcmp(node->value, ">") == 0) res = strdup(lv > rv ? "true" : "false");
-        else if (strcmp(node->value, "&&") == 0) res = strdup((lv && rv) ? "true" : "false");
-        else if (strcmp(node->value, "||") == 0) res = strdup((lv || rv) ? "true" : "false");
+        switch (node->op) {
+            case TOKEN_PLUS:
+                if (starts_number(l) && starts_number(r)) {
+                    res = format_number(lv + rv);
+                } else {
+                    const char* ls = map_display(l);
+                    const char* rs = map_display(r);
+                    res = malloc(strlen(ls) + strlen(rs) + 1);
+                    strcpy(res, ls); strcat(res, rs);
+                }
+                break;
+            case TOKEN_MINUS: res = format_number(lv - rv); break;
+            case TOKEN_STAR: res = format_number(lv * rv); break;
+            case TOKEN_SLASH: res = format_number(rv != 0 ? lv / rv : 0); break;
+            case TOKEN_EQ_EQ: res = strdup(strcmp(l, r) == 0 ? "true" : "false"); break;
+            case TOKEN_BANG_EQ: res = strdup(strcmp(l, r) != 0 ? "true" : "false"); break;
+            case TOKEN_LT: res = strdup(lv < rv ? "true" : "false"); break;
+            case TOKEN_GT: res = strdup(lv > rv ? "true" : "false"); break;
+            case TOKEN_AND: res = strdup((lv && rv) ? "true" : "false"); break;
+            case TOKEN_OR: res = strdup((lv || rv) ? "true" : "false"); break;
+            default: break;
+        }
         free(l); free(r);
         return res ? res : strdup("");
     }
     if (node->type == NODE_LIST) return strdup("[Lista]");
+    if (node->type == NODE_MAP) return evaluate_map(node);
     if (node->type == NODE_INDEX) {
-        // Return dummy value for indexing
-        return strdup("Item");
+        char* key = evaluate_node(node->index);
+        Map* map = get_map(node);
+        if (map) {
+            const char* v = map_get(map, key);
+            free(key);
+            if (!v) { report_error("E012", node->line); return strdup(""); }
+            return strdup(v);
+        }
+        free(key);
+        // Return dummy value for list indexing
+        return strdup(is_list_variable(node->value) ? "Item" : "");
     }
     return strdup("");
 }
 
+// Stops the whole run; the error and where it happened stay in
+// abort_code/abort_line for the embedder after interpret() returns.
+void runtime_abort(const char* code, int line) {
+    if (should_abort) return;
+    report_error(code, line);
+    if (current_task->call_depth > 0) {
+        CallFrame* frame = &current_task->call_stack[current_task->call_depth - 1];
+        printf("  en la función '%s' (llamada en linea %d)\n", frame->func->name, frame->line);
+    }
+    abort_code = code;
+    abort_line = line;
+    should_abort = true;
+}
+
 void interpret(ASTNode* node) {
+    abort_code = NULL;
     interpret_node(node);
+    // Other tasks unwind before the abort is cleared
+    if (should_abort) task_wait_all();
+    should_abort = false;
 }
@@ -48,10 +48,13 @@ Token lexer_collect_string(Lexer* lexer) {
     while (lexer->cur != '\0' && lexer->cur != '"') {
         lexer_advance(lexer);
     }
-    size_t len = lexer->pos - start;
-    char* value = malloc(len + 1);
-    strncpy(value, &lexer->source[start], len);
-    value[len] = '\0';
+    const char* value = intern(&lexer->source[start], lexer->pos - start);
+    if (strchr(value, MAP_HANDLE_MARK)) {
+        char* text = strdup(value);
+        strip_handle_marks(text);
+        value = intern_cstr(text);
+        free(text);
+    }
     lexer_advance(lexer); // skip "
     return (Token){TOKEN_STRING, value, start_line};
 }
@@ -62,41 +65,26 @@ Token lexer_collect_id_or_keyword(Lexer* lexer) {
     while (lexer->cur != '\0' && (isalnum(lexer->cur) || lexer->cur == '_')) {
         lexer_advance(lexer);
     }
-    size_t len = lexer->pos - start;
-    char* value = malloc(len + 1);
-    strncpy(value, &lexer->source[start], len);
-    value[len] = '\0';
-
-    if (strcmp(value, "print") == 0) { free(value); return (Token){TOKEN_PRINT, NULL, start_line}; }
-    if (strcmp(value, "input") == 0) { free(value); return (Token){TOKEN_INPUT, NULL, start_line}; }
-    if (strcmp(value, "var") == 0) { free(value); return (Token){TOKEN_VAR, NULL, start_line}; }
-    if (strcmp(value, "val") == 0) { free(value); return (Token){TOKEN_VAL, NULL, start_line}; }
-    if (strcmp(value, "func") == 0) { free(value); return (Token){TOKEN_FUNC, NULL, start_line}; }
-    if (strcmp(value, "if") == 0) { free(value); return (Token){TOKEN_IF, NULL, start_line}; }
-    if (strcmp(value, "else") == 0) { free(value); return (Token){TOKEN_ELSE, NULL, start_line}; }
-    if (strcmp(value, "while") == 0) { free(value); return (Token){TOKEN_WHILE, NULL, start_line}; }
-    if (strcmp(value, "return") == 0) { free(value); return (Token){TOKEN_RETURN, NULL, start_line}; }
-    if (strcmp(value, "break") == 0) { free(value); return (Token){TOKEN_BREAK, NULL, start_line}; }
-    if (strcmp(value, "continue") == 0) { free(value); return (Token){TOKEN_CONTINUE, NULL, start_line}; }
-    if (strcmp(value, "import") == 0) { free(value); return (Token){TOKEN_IMPORT, NULL, start_line}; }
-    
+    const char* value = intern(&lexer->source[start], lexer->pos - start);
+    TokenType keyword = intern_keyword(value);
+    if (keyword != TOKEN_IDENTIFIER) return (Token){keyword, NULL, start_line};
     return (Token){TOKEN_IDENTIFIER, value, start_line};
 }
 
 Token lexer_collect_number(Lexer* lexer) {
     int start_line = lexer->line;
     size_t start = lexer->pos;
-    while (lexer->cur != '\0' && (isdigit(lexer->cur) || lexer->cur == '.')) {
+    // Stop before `..` so ranges like 0..10 lex as number, range, number
+    while (lexer->cur != '\0' && (isdigit(lexer->cur) ||
+           (lexer->cur == '.' && lexer->source[lexer->pos + 1] != '.'))) {
         lexer_advance(lexer);
     }
-    size_t len = lexer->pos - start;
-    char* value = malloc(len + 1);
-    strncpy(value, &lexer->source[start], len);
-    value[len] = '\0';
+    const char* value = intern(&lexer->source[start], lexer->pos - start);
     return (Token){TOKEN_NUMBER, value, start_line};
 }
 
 Token lexer_get_raw_token(Lexer* lexer) {
+    STAT_INC(tokens);
     while (lexer->cur != '\0') {
         lexer_skip_whitespace(lexer);
         if (lexer->cur == '/' && (lexer->source[lexer->pos + 1] == '/' || lexer->source[lexer->pos + 1] == '*')) {
@@ -118,6 +106,9 @@ Token lexer_get_raw_token(Lexer* lexer) {
         if (lexer->cur == ':') { lexer_advance(lexer); return (Token){TOKEN_COLON, NULL, current_line}; }
         if (lexer->cur == ',') { lexer_advance(lexer); return (Token){TOKEN_COMMA, NULL, current_line}; }
         if (lexer->cur == ';') { lexer_advance(lexer); return (Token){TOKEN_SEMICOLON, NULL, current_line}; }
+        if (lexer->cur == '.' && lexer->source[lexer->pos + 1] == '.') {
+            lexer_advance(lexer); lexer_advance(lexer); return (Token){TOKEN_DOT_DOT, NULL, current_line};
+        }
         if (lexer->cur == '+') { lexer_advance(lexer); return (Token){TOKEN_PLUS, NULL, current_line}; }
         if (lexer->cur == '-') { lexer_advance(lexer); return (Token){TOKEN_MINUS, NULL, current_line}; }
         if (lexer->cur == '*') { lexer_advance(lexer); return (Token){TOKEN_STAR, NULL, current_line}; }
@@ -159,5 +150,6 @@ Token lexer_peek_token(Lexer* lexer) {
 }
 
 void token_free(Token token) {
-    if (token.value) free(token.value);
+    // Token values are interned and live for the whole run
+    (void)token;
 }
@@ -8,13 +8,119 @@ void run_source(const char* source) {
     Lexer lexer;
     lexer_init(&lexer, source);
 
+    budget_start();
+    STAT_TIMER_START(parse_start);
     ASTNode* root = parse(&lexer);
+    STAT_TIMER_STOP(parse_ms, parse_start);
     if (root) {
+        STAT_TIMER_START(run_start);
+        Function* before = function_table;
         interpret(root);
-        free_ast(root);
+        task_wait_all();
+        STAT_TIMER_STOP(run_ms, run_start);
+        // Functions declared here stay callable (REPL, snapshots)
+        if (function_table == before) free_ast(root);
     }
 }
 
+typedef struct {
+    char buf[1 << 16];
+    size_t pos;
+    size_t filled;
+    char* line;
+    size_t line_cap;
+} RecordReader;
+
+// Returns the next line of stdin without its newline, or NULL at EOF.
+// The returned buffer is reused by the next call.
+char* read_record(RecordReader* r) {
+    size_t len = 0;
+    bool got = false;
+    while (1) {
+        if (r->pos == r->filled) {
+            r->filled = fread(r->buf, 1, sizeof(r->buf), stdin);
+            r->pos = 0;
+            if (r->filled == 0) break;
+        }
+        char* start = r->buf + r->pos;
+        char* nl = memchr(start, '\n', r->filled - r->pos);
+        size_t n = nl ? (size_t)(nl - start) : r->filled - r->pos;
+        if (len + n + 1 > r->line_cap) {
+            while (len + n + 1 > r->line_cap) r->line_cap = r->line_cap ? r->line_cap * 2 : 256;
+            r->line = realloc(r->line, r->line_cap);
+        }
+        memcpy(r->line + len, start, n);
+        len += n;
+        r->pos += n + (nl ? 1 : 0);
+        got = true;
+        if (nl) break;
+    }
+    if (!got) return NULL;
+    if (len > 0 && r->line[len - 1] == '\r') len--;
+    r->line[len] = '\0';
+    strip_handle_marks(r->line);
+    return r->line;
+}
+
+// Modo registro (-n): el script se analiza una vez. Los imports, las
+// funciones y las variables globales se ejecutan una sola vez antes de
+// BEGIN, BEGIN/END se ejecutan al inicio y al final, y el resto se ejecuta
+// por cada línea con `linea` y `nr`.
+int run_records(const char* source) {
+    Lexer lexer;
+    lexer_init(&lexer, source);
+    STAT_TIMER_START(parse_start);
+    ASTNode* root = parse(&lexer);
+    STAT_TIMER_STOP(parse_ms, parse_start);
+
+    const char* begin_name = intern_cstr("BEGIN");
+    const char* end_name = intern_cstr("END");
+    const char* line_name = intern_cstr("linea");
+    const char* nr_name = intern_cstr("nr");
+    ASTNode *decls = NULL, *begin = NULL, *end = NULL, *body = NULL;
+    ASTNode **decls_tail = &decls, **begin_tail = &begin, **end_tail = &end, **body_tail = &body;
+    while (root) {
+        ASTNode* next = root->right;
+        root->right = NULL;
+        if (root->type == NODE_FUNC_DECL || root->type == NODE_VAR_DECL || root->type == NODE_IMPORT) { *decls_tail = root; decls_tail = &root->right; }
+        else if (root->type == NODE_BLOCK && root->value == begin_name) { *begin_tail = root; begin_tail = &root->right; }
+        else if (root->type == NODE_BLOCK && root->value == end_name) { *end_tail = root; end_tail = &root->right; }
+        else { *body_tail = root; body_tail = &root->right; }
+        root = next;
+    }
+
+    static char out_buf[1 << 16];
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    budget_start();
+    STAT_TIMER_START(run_start);
+    // interpret() clears abort_code, so each phase only runs if the last one succeeded
+    set_variable(nr_name, TYPE_INT, "0", false);
+    interpret(decls);
+    if (!abort_code) interpret(begin);
+
+    RecordReader* reader = calloc(1, sizeof(RecordReader));
+    unsigned long nr = 0;
+    char nr_buf[32];
+    char* line;
+    while (!abort_code && (line = read_record(reader))) {
+        snprintf(nr_buf, sizeof(nr_buf), "%lu", ++nr);
+        set_variable(nr_name, TYPE_INT, nr_buf, false);
+        set_variable(line_name, TYPE_STR, line, false);
+        interpret(body);
+    }
+    if (!abort_code) interpret(end);
+    task_wait_all();
+    STAT_TIMER_STOP(run_ms, run_start);
+    fflush(stdout);
+
+    free(reader->line);
+    free(reader);
+    free_ast(begin);
+    free_ast(body);
+    free_ast(end);
+    return abort_code ? 2 : 0;
+}
+
 void run_repl() {
     char line[1024];
     printf("Stow Programming Language [Version 1.0]\n");
@@ -41,20 +147,77 @@ void run_repl() {
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc >= 2) {
+typedef struct {
+    const char* script;
+    const char* snapshot_out;
+    const char* snapshot_in;
+    bool show_stats;
+    bool record_mode;
+    int status;
+} Options;
+
+Options options;
+
+void run_main(void) {
+    const char* script = options.script;
+    if (options.snapshot_in && !snapshot_load(options.snapshot_in)) { options.status = 1; return; }
+
+    if (options.snapshot_out) {
+        // Ejecutar el preludio y guardar el estado resultante
+        char* source = script ? read_file(script) : NULL;
+        if (!source) { options.status = 1; return; }
+        run_source(source);
+        free(source);
+        if (abort_code || !snapshot_save(options.snapshot_out)) { options.status = 2; return; }
+    } else if (options.record_mode && script) {
+        char* source = read_file(script);
+        if (!source) { options.status = 1; return; }
+        options.status = run_records(source);
+        free(source);
+    } else if (script) {
         // Ejecutar archivo
-        char* source = read_file(argv[1]);
-        if (source) {
-            run_source(source);
-            free(source);
-        } else {
-            return 1;
-        }
+        char* source = read_file(script);
+        if (!source) { options.status = 1; return; }
+        run_source(source);
+        free(source);
+        if (abort_code) options.status = 2;
     } else {
         // Iniciar REPL
         run_repl();
     }
 
-    return 0;
+    if (options.show_stats) {
+#ifdef STOW_STATS
+        stats_report(stderr);
+#else
+        fprintf(stderr, "Aviso: --stats requiere compilar con 'make stats'\n");
+#endif
+    }
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            max_call_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            budget.max_steps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-heap") == 0 && i + 1 < argc) {
+            budget.max_heap = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-time") == 0 && i + 1 < argc) {
+            budget.max_time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            options.snapshot_out = argv[++i];
+        } else if (strcmp(argv[i], "--from-snapshot") == 0 && i + 1 < argc) {
+            options.snapshot_in = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            options.record_mode = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.show_stats = true;
+        } else {
+            options.script = argv[i];
+        }
+    }
+
+    task_run_main(run_main);
+    return options.status;
 }
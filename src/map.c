@@ -0,0 +1,259 @@
+#include "stow.h"
+
+// Open addressing with Robin Hood probing: every slot records how far it
+// sits from its home bucket, so lookups stop as soon as they meet an entry
+// that is closer to home than the key being searched.
+
+#define MAP_MIN_CAPACITY 8
+
+uint32_t map_hash(const char* key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+Map* map_new(void) {
+    Map* map = malloc(sizeof(Map));
+    map->capacity = MAP_MIN_CAPACITY;
+    map->count = 0;
+    map->slots = calloc(map->capacity, sizeof(MapSlot));
+    map->id = 0;
+    map->marked = false;
+    return map;
+}
+
+void map_free(Map* map) {
+    if (!map) return;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].dist) {
+            heap_in_use -= strlen(map->slots[i].key) + strlen(map->slots[i].value) + 2;
+            free(map->slots[i].key);
+            free(map->slots[i].value);
+        }
+    }
+    free(map->slots);
+    free(map);
+}
+
+// Places an entry that is known not to be in the table yet.
+static void map_place(Map* map, MapSlot entry) {
+    size_t mask = map->capacity - 1;
+    size_t i = entry.hash & mask;
+    entry.dist = 1;
+    while (map->slots[i].dist) {
+        if (map->slots[i].dist < entry.dist) {
+            MapSlot tmp = map->slots[i];
+            map->slots[i] = entry;
+            entry = tmp;
+        }
+        i = (i + 1) & mask;
+        entry.dist++;
+    }
+    map->slots[i] = entry;
+    map->count++;
+}
+
+static void map_grow(Map* map) {
+    MapSlot* old = map->slots;
+    size_t old_cap = map->capacity;
+    map->capacity *= 2;
+    map->count = 0;
+    map->slots = calloc(map->capacity, sizeof(MapSlot));
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].dist) map_place(map, old[i]);
+    }
+    free(old);
+}
+
+static MapSlot* map_find(Map* map, const char* key, uint32_t hash) {
+    size_t mask = map->capacity - 1;
+    size_t i = hash & mask;
+    uint32_t dist = 1;
+    while (map->slots[i].dist >= dist) {
+        MapSlot* s = &map->slots[i];
+        if (s->hash == hash && strcmp(s->key, key) == 0) return s;
+        i = (i + 1) & mask;
+        dist++;
+    }
+    return NULL;
+}
+
+const char* map_get(Map* map, const char* key) {
+    MapSlot* s = map_find(map, key, map_hash(key));
+    return s ? s->value : NULL;
+}
+
+void map_set(Map* map, const char* key, const char* value) {
+    uint32_t hash = map_hash(key);
+    MapSlot* s = map_find(map, key, hash);
+    if (s) {
+        heap_in_use += strlen(value);
+        heap_in_use -= strlen(s->value);
+        free(s->value);
+        s->value = strdup(value);
+        return;
+    }
+    if ((map->count + 1) * 8 > map->capacity * 7) map_grow(map);
+    heap_in_use += strlen(key) + strlen(value) + 2;
+    map_place(map, (MapSlot){hash, 0, strdup(key), strdup(value)});
+}
+
+bool map_remove(Map* map, const char* key) {
+    MapSlot* s = map_find(map, key, map_hash(key));
+    if (!s) return false;
+    heap_in_use -= strlen(s->key) + strlen(s->value) + 2;
+    free(s->key);
+    free(s->value);
+    // Backward-shift deletion keeps probe sequences tombstone-free
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(s - map->slots);
+    size_t next = (i + 1) & mask;
+    while (map->slots[next].dist > 1) {
+        map->slots[i] = map->slots[next];
+        map->slots[i].dist--;
+        i = next;
+        next = (next + 1) & mask;
+    }
+    map->slots[i] = (MapSlot){0, 0, NULL, NULL};
+    map->count--;
+    return true;
+}
+
+char* map_keys(Map* map) {
+    size_t len = 3;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].dist) len += strlen(map->slots[i].key) + 2;
+    }
+    char* res = malloc(len);
+    char* out = res;
+    *out++ = '[';
+    bool first = true;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (!map->slots[i].dist) continue;
+        if (!first) { *out++ = ','; *out++ = ' '; }
+        first = false;
+        size_t n = strlen(map->slots[i].key);
+        memcpy(out, map->slots[i].key, n);
+        out += n;
+    }
+    *out++ = ']';
+    *out = '\0';
+    return res;
+}
+
+#define MAP_COLLECT_MIN 256
+
+// Slot table for handles. Freed slots go on a free list and are reused;
+// the generation in the handle tells a stale handle from the map that
+// now owns its slot.
+typedef struct {
+    Map* map; // NULL while free
+    uint32_t generation;
+    uint32_t next_free; // index + 1 of the next free slot, 0 = none
+} MapEntry;
+
+static MapEntry* map_values = NULL; // indexed by id - 1
+static size_t map_value_count = 0;
+static size_t map_value_capacity = 0;
+static uint32_t map_free_head = 0;
+size_t map_live = 0;
+size_t map_collect_at = MAP_COLLECT_MIN;
+
+Map* map_create(void) {
+    uint32_t id = map_free_head;
+    if (id) {
+        map_free_head = map_values[id - 1].next_free;
+    } else {
+        if (map_value_count == map_value_capacity) {
+            map_value_capacity = map_value_capacity ? map_value_capacity * 2 : 64;
+            map_values = realloc(map_values, map_value_capacity * sizeof(MapEntry));
+        }
+        map_values[map_value_count++] = (MapEntry){NULL, 0, 0};
+        id = (uint32_t)map_value_count;
+    }
+    Map* map = map_new();
+    map->id = id;
+    map_values[id - 1].map = map;
+    map_values[id - 1].next_free = 0;
+    map_live++;
+    return map;
+}
+
+char* map_handle(Map* map) {
+    char* handle = malloc(32);
+    snprintf(handle, 32, "%cmap#%u.%u", MAP_HANDLE_MARK, map->id, map_values[map->id - 1].generation);
+    return handle;
+}
+
+// Splits a handle into its id and generation; false for any other value
+static bool map_parse_handle(const char* value, uint32_t* id, uint32_t* generation) {
+    if (value[0] != MAP_HANDLE_MARK || strncmp(value + 1, "map#", 4) != 0) return false;
+    const char* p = value + 5;
+    unsigned long parts[2];
+    for (int i = 0; i < 2; i++) {
+        if (!isdigit((unsigned char)*p)) return false;
+        char* end;
+        parts[i] = strtoul(p, &end, 10);
+        if (parts[i] > UINT32_MAX || *end != (i == 0 ? '.' : '\0')) return false;
+        p = end + 1;
+    }
+    *id = (uint32_t)parts[0];
+    *generation = (uint32_t)parts[1];
+    return *id != 0;
+}
+
+// Returns the id in a map handle, 0 for any other value
+uint32_t map_handle_id(const char* value) {
+    uint32_t id, generation;
+    return map_parse_handle(value, &id, &generation) ? id : 0;
+}
+
+Map* map_from_value(const char* value) {
+    uint32_t id, generation;
+    if (!map_parse_handle(value, &id, &generation) || id > map_value_count) return NULL;
+    MapEntry* e = &map_values[id - 1];
+    return e->generation == generation ? e->map : NULL;
+}
+
+// What print, `+` and str() show for a value; a handle shows as "[Mapa]"
+const char* map_display(const char* value) {
+    return map_handle_id(value) ? "[Mapa]" : value;
+}
+
+void strip_handle_marks(char* s) {
+    char* out = s;
+    for (; *s; s++) {
+        if (*s != MAP_HANDLE_MARK) *out++ = *s;
+    }
+    *out = '\0';
+}
+
+void map_mark(const char* value) {
+    Map* map = map_from_value(value);
+    if (!map || map->marked) return;
+    map->marked = true;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].dist) map_mark(map->slots[i].value);
+    }
+}
+
+void map_sweep(void) {
+    for (size_t i = 0; i < map_value_count; i++) {
+        MapEntry* e = &map_values[i];
+        if (!e->map) continue;
+        if (e->map->marked) {
+            e->map->marked = false;
+        } else {
+            map_free(e->map);
+            e->map = NULL;
+            e->generation++;
+            e->next_free = map_free_head;
+            map_free_head = (uint32_t)i + 1;
+            map_live--;
+        }
+    }
+    map_collect_at = map_live * 2 > MAP_COLLECT_MIN ? map_live * 2 : MAP_COLLECT_MIN;
+}
@@ -0,0 +1,112 @@
+#include "stow.h"
+
+// Result cache for `memo func`: a fixed bucket array sized for the entry
+// bound, plus a doubly linked list in recency order for LRU eviction.
+
+MemoCache* memo_new(size_t capacity) {
+    MemoCache* cache = malloc(sizeof(MemoCache));
+    size_t buckets = 8;
+    while (buckets < capacity) buckets *= 2;
+    cache->buckets = calloc(buckets, sizeof(MemoEntry*));
+    cache->bucket_count = buckets;
+    cache->count = 0;
+    cache->capacity = capacity;
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->line = 0;
+    cache->generation = 0;
+    cache->pure = true;
+    return cache;
+}
+
+// Drops every entry; the counters are kept
+void memo_clear(MemoCache* cache) {
+    while (cache->head) {
+        MemoEntry* e = cache->head;
+        cache->head = e->next;
+        free(e->key);
+        free(e->value);
+        free(e);
+    }
+    cache->tail = NULL;
+    cache->count = 0;
+    memset(cache->buckets, 0, cache->bucket_count * sizeof(MemoEntry*));
+}
+
+void memo_free(MemoCache* cache) {
+    memo_clear(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+static void memo_unlink(MemoCache* cache, MemoEntry* e) {
+    if (e->prev) e->prev->next = e->next; else cache->head = e->next;
+    if (e->next) e->next->prev = e->prev; else cache->tail = e->prev;
+}
+
+static void memo_push_front(MemoCache* cache, MemoEntry* e) {
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head) cache->head->prev = e;
+    cache->head = e;
+    if (!cache->tail) cache->tail = e;
+}
+
+static void memo_evict(MemoCache* cache) {
+    MemoEntry* victim = cache->tail;
+    memo_unlink(cache, victim);
+    MemoEntry** slot = &cache->buckets[victim->hash & (cache->bucket_count - 1)];
+    while (*slot != victim) slot = &(*slot)->chain;
+    *slot = victim->chain;
+    free(victim->key);
+    free(victim->value);
+    free(victim);
+    cache->count--;
+    cache->evictions++;
+}
+
+const char* memo_get(MemoCache* cache, const char* key) {
+    uint32_t hash = map_hash(key);
+    for (MemoEntry* e = cache->buckets[hash & (cache->bucket_count - 1)]; e; e = e->chain) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) {
+            memo_unlink(cache, e);
+            memo_push_front(cache, e);
+            cache->hits++;
+            return e->value;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+void memo_put(MemoCache* cache, const char* key, const char* value) {
+    if (cache->count >= cache->capacity) memo_evict(cache);
+    MemoEntry* e = malloc(sizeof(MemoEntry));
+    e->hash = map_hash(key);
+    e->key = strdup(key);
+    e->value = strdup(value);
+    size_t b = e->hash & (cache->bucket_count - 1);
+    e->chain = cache->buckets[b];
+    cache->buckets[b] = e;
+    memo_push_front(cache, e);
+    cache->count++;
+}
+
+// Arguments are joined with the ASCII unit separator
+char* memo_key(char** args, int argc) {
+    size_t len = 1;
+    for (int i = 0; i < argc; i++) len += strlen(args[i]) + 1;
+    char* key = malloc(len);
+    char* out = key;
+    for (int i = 0; i < argc; i++) {
+        size_t n = strlen(args[i]);
+        memcpy(out, args[i], n);
+        out += n;
+        *out++ = '\x1f';
+    }
+    *out = '\0';
+    return key;
+}
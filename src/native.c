@@ -0,0 +1,116 @@
+#include "stow.h"
+#include <math.h>
+#include <time.h>
+
+// Registry of C-implemented functions. Calls check it before
+// function_table; names are interned, so the table is keyed on the
+// symbol pointer itself.
+
+static NativeFunction** native_slots = NULL;
+static size_t native_capacity = 0;
+static size_t native_count = 0;
+int native_line = 0;
+
+static size_t native_hash(const char* sym) {
+    uintptr_t p = (uintptr_t)sym;
+    return (size_t)((p >> 4) ^ (p >> 12));
+}
+
+static void native_insert(NativeFunction* nf) {
+    size_t i = native_hash(nf->name) & (native_capacity - 1);
+    while (native_slots[i] && native_slots[i]->name != nf->name) i = (i + 1) & (native_capacity - 1);
+    if (!native_slots[i]) native_count++;
+    else free(native_slots[i]);
+    native_slots[i] = nf;
+}
+
+static void native_grow(void) {
+    NativeFunction** old = native_slots;
+    size_t old_cap = native_capacity;
+    native_capacity = native_capacity ? native_capacity * 2 : 64;
+    native_slots = calloc(native_capacity, sizeof(NativeFunction*));
+    native_count = 0;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i]) native_insert(old[i]);
+    }
+    free(old);
+}
+
+static void native_stdlib_init(void);
+
+void register_native(const char* name, const char* signature, bool pure, NativeFn fn) {
+    if (!native_slots) native_stdlib_init();
+    if ((native_count + 1) * 2 > native_capacity) native_grow();
+    NativeFunction* nf = malloc(sizeof(NativeFunction));
+    nf->name = intern_cstr(name);
+    nf->signature = signature;
+    nf->arity = (int)strlen(signature);
+    nf->pure = pure;
+    nf->fn = fn;
+    native_insert(nf);
+}
+
+NativeFunction* find_native(const char* name) {
+    if (!native_slots) native_stdlib_init();
+    size_t i = native_hash(name) & (native_capacity - 1);
+    while (native_slots[i]) {
+        if (native_slots[i]->name == name) return native_slots[i];
+        i = (i + 1) & (native_capacity - 1);
+    }
+    return NULL;
+}
+
+static char* native_bool(bool v) {
+    return strdup(v ? "true" : "false");
+}
+
+static char* native_sqrt(NativeArg* args) { return format_number(sqrt(args[0].num)); }
+static char* native_abs(NativeArg* args) { return format_number(fabs(args[0].num)); }
+static char* native_floor(NativeArg* args) { return format_number(floor(args[0].num)); }
+static char* native_ceil(NativeArg* args) { return format_number(ceil(args[0].num)); }
+static char* native_round(NativeArg* args) { return format_number(round(args[0].num)); }
+static char* native_pow(NativeArg* args) { return format_number(pow(args[0].num, args[1].num)); }
+static char* native_min(NativeArg* args) { return format_number(fmin(args[0].num, args[1].num)); }
+static char* native_max(NativeArg* args) { return format_number(fmax(args[0].num, args[1].num)); }
+static char* native_int(NativeArg* args) { return format_number(trunc(args[0].num)); }
+static char* native_num(NativeArg* args) { return format_number(args[0].num); }
+
+static char* native_str(NativeArg* args) { return strdup(map_display(args[0].str)); }
+
+static char* native_len(NativeArg* args) {
+    return format_number((double)(args[0].map ? args[0].map->count : strlen(args[0].str)));
+}
+
+static char* native_time(NativeArg* args) {
+    (void)args;
+    return format_number((double)time(NULL));
+}
+
+// Milliseconds of CPU time used by the process
+static char* native_clock(NativeArg* args) {
+    (void)args;
+    return format_number((double)clock() * 1000.0 / CLOCKS_PER_SEC);
+}
+
+static char* native_has(NativeArg* args) { return native_bool(map_get(args[0].map, args[1].str) != NULL); }
+static char* native_remove(NativeArg* args) { return native_bool(map_remove(args[0].map, args[1].str)); }
+static char* native_keys(NativeArg* args) { return map_keys(args[0].map); }
+
+static void native_stdlib_init(void) {
+    native_grow();
+    static const struct { const char* name; const char* signature; bool pure; NativeFn fn; } stdlib[] = {
+        {"sqrt", "n", true, native_sqrt}, {"abs", "n", true, native_abs},
+        {"floor", "n", true, native_floor}, {"ceil", "n", true, native_ceil},
+        {"round", "n", true, native_round}, {"pow", "nn", true, native_pow},
+        {"min", "nn", true, native_min}, {"max", "nn", true, native_max},
+        {"int", "n", true, native_int}, {"num", "n", true, native_num},
+        {"str", "a", true, native_str}, {"len", "a", true, native_len},
+        {"time", "", false, native_time}, {"clock", "", false, native_clock},
+        {"has", "ms", true, native_has}, {"remove", "ms", false, native_remove},
+        {"keys", "m", true, native_keys},
+    };
+    for (size_t i = 0; i < sizeof(stdlib) / sizeof(stdlib[0]); i++) {
+        register_native(stdlib[i].name, stdlib[i].signature, stdlib[i].pure, stdlib[i].fn);
+    }
+    task_register_natives();
+}
@@ -21,12 +21,14 @@ void report_error(const char* errorCode, int line) {
     fclose(f);
 }
 
-ASTNode* create_node(NodeType type, char* value, int line) {
+ASTNode* create_node(NodeType type, const char* value, int line) {
+    STAT_INC(ast_nodes);
     ASTNode* node = malloc(sizeof(ASTNode));
     node->type = type;
-    node->value = value ? strdup(value) : NULL;
+    node->value = value;
     node->var_name = NULL;
     node->var_type = TYPE_UNKNOWN;
+    node->op = TOKEN_UNKNOWN;
     node->line = line;
     node->left = NULL;
     node->right = NULL;
@@ -49,20 +51,11 @@ void free_ast(ASTNode* node) {
     free_ast(node->params);
     free_ast(node->next_param);
     free_ast(node->index);
-    if (node->value) free(node->value);
-    if (node->var_name) free(node->var_name);
     free(node);
 }
 
 DataType string_to_type(const char* type_str) {
-    if (!type_str) return TYPE_UNKNOWN;
-    if (strcmp(type_str, "Int") == 0) return TYPE_INT;
-    if (strcmp(type_str, "Str") == 0) return TYPE_STR;
-    if (strcmp(type_str, "Float") == 0) return TYPE_FLOAT;
-    if (strcmp(type_str, "Bool") == 0) return TYPE_BOOL;
-    if (strcmp(type_str, "Void") == 0) return TYPE_VOID;
-    if (strcmp(type_str, "List") == 0) return TYPE_LIST;
-    return TYPE_UNKNOWN;
+    return intern_type(type_str);
 }
 
 ASTNode* parse_expression(Lexer* lexer);
@@ -75,6 +68,21 @@ ASTNode* parse_atom(Lexer* lexer) {
     } else if (token.type == TOKEN_NUMBER) {
         ASTNode* n = create_node(NODE_NUMBER, token.value, token.line);
         token_free(token); return n;
+    } else if (token.type == TOKEN_MINUS) {
+        // Unary minus: folded into number literals, 0 - x otherwise
+        int l = token.line;
+        if (lexer_peek_token(lexer).type == TOKEN_NUMBER) {
+            Token num = lexer_next_token(lexer);
+            char buf[64];
+            snprintf(buf, sizeof(buf), "-%s", num.value);
+            token_free(num);
+            return create_node(NODE_NUMBER, intern_cstr(buf), l);
+        }
+        ASTNode* neg = create_node(NODE_BIN_OP, NULL, l);
+        neg->op = TOKEN_MINUS;
+        neg->left = create_node(NODE_NUMBER, intern_cstr("0"), l);
+        neg->right = parse_atom(lexer);
+        return neg;
     } else if (token.type == TOKEN_INPUT) {
         int l = token.line;
         lexer_next_token(lexer); // (
@@ -84,9 +92,8 @@ ASTNode* parse_atom(Lexer* lexer) {
         n->left = prompt;
         token_free(token); return n;
     } else if (token.type == TOKEN_IDENTIFIER) {
-        char* name = strdup(token.value);
+        const char* name = token.value;
         int l = token.line;
-        token_free(token);
         if (lexer_peek_token(lexer).type == TOKEN_LPAREN) {
             lexer_next_token(lexer); // (
             ASTNode* call = create_node(NODE_FUNC_CALL, name, l);
@@ -103,17 +110,16 @@ ASTNode* parse_atom(Lexer* lexer) {
                 }
             }
             lexer_next_token(lexer); // )
-            free(name); return call;
+            return call;
         } else if (lexer_peek_token(lexer).type == TOKEN_LBRACKET) {
             lexer_next_token(lexer); // [
             ASTNode* idx = parse_expression(lexer);
             lexer_next_token(lexer); // ]
             ASTNode* node = create_node(NODE_INDEX, name, l);
             node->index = idx;
-            free(name); return node;
+            return node;
         }
-        ASTNode* n = create_node(NODE_IDENTIFIER, name, l);
-        free(name); return n;
+        return create_node(NODE_IDENTIFIER, name, l);
     } else if (token.type == TOKEN_LBRACKET) {
         int l = token.line;
         ASTNode* list = create_node(NODE_LIST, NULL, l);
@@ -130,6 +136,25 @@ ASTNode* parse_atom(Lexer* lexer) {
         }
         lexer_next_token(lexer); // ]
         token_free(token); return list;
+    } else if (token.type == TOKEN_LBRACE) {
+        int l = token.line;
+        ASTNode* map = create_node(NODE_MAP, NULL, l);
+        if (lexer_peek_token(lexer).type != TOKEN_RBRACE) {
+            ASTNode* last = NULL;
+            while (1) {
+                ASTNode* pair = create_node(NODE_PAIR, NULL, lexer_peek_token(lexer).line);
+                pair->index = parse_expression(lexer);
+                lexer_next_token(lexer); // :
+                pair->left = parse_expression(lexer);
+                if (!map->params) map->params = pair;
+                else last->next_param = pair;
+                last = pair;
+                if (lexer_peek_token(lexer).type == TOKEN_COMMA) lexer_next_token(lexer);
+                else break;
+            }
+        }
+        lexer_next_token(lexer); // }
+        token_free(token); return map;
     }
     token_free(token); return NULL;
 }
@@ -139,21 +164,8 @@ ASTNode* parse_expression(Lexer* lexer) {
     Token peek = lexer_peek_token(lexer);
     if (peek.type >= TOKEN_PLUS && peek.type <= TOKEN_OR) {
         lexer_next_token(lexer);
-        char* op = NULL;
-        switch(peek.type) {
-            case TOKEN_PLUS: op = "+"; break;
-            case TOKEN_MINUS: op = "-"; break;
-            case TOKEN_STAR: op = "*"; break;
-            case TOKEN_SLASH: op = "/"; break;
-            case TOKEN_EQ_EQ: op = "=="; break;
-            case TOKEN_BANG_EQ: op = "!="; break;
-            case TOKEN_LT: op = "<"; break;
-            case TOKEN_GT: op = ">"; break;
-            case TOKEN_AND: op = "&&"; break;
-            case TOKEN_OR: op = "||"; break;
-            default: op = "?";
-        }
-        ASTNode* bin = create_node(NODE_BIN_OP, op, peek.line);
+        ASTNode* bin = create_node(NODE_BIN_OP, NULL, peek.line);
+        bin->op = peek.type;
         bin->left = left;
         bin->right = parse_expression(lexer);
         return bin;
@@ -202,9 +214,9 @@ ASTNode* parse_statement(Lexer* lexer) {
         ASTNode* expr = parse_expression(lexer);
         lexer_next_token(lexer); // ;
         ASTNode* n = create_node(NODE_VAR_DECL, NULL, l);
-        n->var_name = strdup(id.value);
+        n->var_name = id.value;
         n->var_type = string_to_type(type_tok.value);
-        n->value = is_const ? strdup("val") : strdup("var");
+        n->op = is_const ? TOKEN_VAL : TOKEN_VAR;
         n->left = expr;
         token_free(id); token_free(type_tok); return n;
     }
@@ -240,6 +252,22 @@ ASTNode* parse_statement(Lexer* lexer) {
         token_free(id); token_free(ret_type); return n;
     }
 
+    if (peek.type == TOKEN_MEMO) {
+        lexer_next_token(lexer);
+        ASTNode* n = parse_statement(lexer);
+        if (n && n->type == NODE_FUNC_DECL) n->op = TOKEN_MEMO;
+        return n;
+    }
+
+    if (peek.type == TOKEN_SPAWN) {
+        int l = peek.line;
+        lexer_next_token(lexer);
+        ASTNode* call = parse_expression(lexer);
+        lexer_next_token(lexer); // ;
+        ASTNode* n = create_node(NODE_SPAWN, NULL, l);
+        n->left = call; return n;
+    }
+
     if (peek.type == TOKEN_RETURN) {
         int l = peek.line;
         lexer_next_token(lexer);
@@ -287,6 +315,28 @@ ASTNode* parse_statement(Lexer* lexer) {
         return n;
     }
 
+    if (peek.type == TOKEN_FOR) {
+        // for i in a..b [step s] { ... }; `in` and `step` stay usable as names
+        int l = peek.line;
+        lexer_next_token(lexer);
+        Token id = lexer_next_token(lexer);
+        lexer_next_token(lexer); // in
+        ASTNode* start = parse_expression(lexer);
+        lexer_next_token(lexer); // ..
+        ASTNode* end = parse_expression(lexer);
+        ASTNode* step = NULL;
+        Token next = lexer_peek_token(lexer);
+        if (next.type == TOKEN_IDENTIFIER && next.value == intern_cstr("step")) {
+            lexer_next_token(lexer);
+            step = parse_expression(lexer);
+        }
+        ASTNode* body = parse_block(lexer);
+        ASTNode* n = create_node(NODE_FOR, NULL, l);
+        n->var_name = id.value;
+        n->left = start; n->condition = end; n->index = step; n->body = body;
+        token_free(id); return n;
+    }
+
     if (peek.type == TOKEN_IMPORT) {
         int l = peek.line;
         lexer_next_token(lexer);
@@ -297,7 +347,16 @@ ASTNode* parse_statement(Lexer* lexer) {
     }
 
     if (peek.type == TOKEN_IDENTIFIER) {
+        static const char *begin_name, *end_name;
+        if (!begin_name) { begin_name = intern_cstr("BEGIN"); end_name = intern_cstr("END"); }
         Token id = lexer_next_token(lexer);
+        if ((id.value == begin_name || id.value == end_name) &&
+            lexer_peek_token(lexer).type == TOKEN_LBRACE) {
+            // BEGIN/END hooks for -n mode; elsewhere they run as plain blocks
+            ASTNode* block = parse_block(lexer);
+            block->value = id.value;
+            token_free(id); return block;
+        }
         if (lexer_peek_token(lexer).type == TOKEN_EQUALS) {
             lexer_next_token(lexer); // =
             ASTNode* expr = parse_expression(lexer);
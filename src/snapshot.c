@@ -0,0 +1,446 @@
+#include "stow.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Image of the interpreter state after a prelude: function_table with the
+// ASTs it points into, and the global symbols. Nodes are stored as raw
+// ASTNode structs whose pointer fields hold 1-based indexes (0 = NULL), so
+// loading is one mapping plus a single relocation pass over the nodes.
+//
+//   header | string pool | ASTNode[] | SnapFunction[] | SnapMap[] (+ pairs) | SnapSymbol[]
+//
+// Maps reachable from the symbols are saved by their old handle id;
+// loading creates new maps and rewrites the handles that refer to them.
+
+#define SNAPSHOT_MAGIC "STOWIMG"
+#define SNAPSHOT_VERSION 2
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t string_count;
+    uint64_t strings_offset;
+    uint64_t node_count;
+    uint64_t nodes_offset;
+    uint64_t func_count;
+    uint64_t funcs_offset;
+    uint64_t map_count;
+    uint64_t maps_offset;
+    uint64_t sym_count;
+    uint64_t syms_offset;
+    uint64_t total_size;
+} SnapHeader;
+
+typedef struct {
+    uint32_t name;
+    uint32_t params;
+    uint32_t body;
+    uint32_t memo; // declaration line + 1 for `memo func`, 0 otherwise
+} SnapFunction;
+
+typedef struct {
+    uint32_t id;
+    uint32_t count; // followed by count (key, value) string pairs
+} SnapMap;
+
+typedef struct {
+    uint32_t name;
+    uint32_t value;
+    uint32_t type;
+    uint32_t flags;
+} SnapSymbol;
+
+#define SNAP_SYM_CONST 1
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static void buf_write(Buffer* b, const void* p, size_t n) {
+    if (b->len + n > b->cap) {
+        while (b->len + n > b->cap) b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void buf_align(Buffer* b) {
+    static const char zeros[8] = {0};
+    if (b->len % 8) buf_write(b, zeros, 8 - b->len % 8);
+}
+
+typedef struct {
+    Buffer strings;
+    Map* string_ids;
+    uint32_t string_count;
+    ASTNode* nodes;
+    size_t node_count;
+    size_t node_cap;
+} SnapWriter;
+
+// Returns the 1-based id of s in the string pool, 0 for NULL
+static uint32_t snap_string(SnapWriter* w, const char* s) {
+    if (!s) return 0;
+    const char* id = map_get(w->string_ids, s);
+    if (id) return (uint32_t)strtoul(id, NULL, 10);
+    uint32_t len = (uint32_t)strlen(s);
+    buf_write(&w->strings, &len, sizeof(len));
+    buf_write(&w->strings, s, len + 1);
+    char b[16];
+    snprintf(b, sizeof(b), "%u", ++w->string_count);
+    map_set(w->string_ids, s, b);
+    return w->string_count;
+}
+
+static uint32_t snap_node(SnapWriter* w, ASTNode* node) {
+    if (!node) return 0;
+    if (w->node_count == w->node_cap) {
+        w->node_cap = w->node_cap ? w->node_cap * 2 : 256;
+        w->nodes = realloc(w->nodes, w->node_cap * sizeof(ASTNode));
+    }
+    size_t idx = w->node_count++;
+    ASTNode copy = *node;
+    copy.value = (const char*)(uintptr_t)snap_string(w, node->value);
+    copy.var_name = (const char*)(uintptr_t)snap_string(w, node->var_name);
+    copy.left = (ASTNode*)(uintptr_t)snap_node(w, node->left);
+    copy.right = (ASTNode*)(uintptr_t)snap_node(w, node->right);
+    copy.condition = (ASTNode*)(uintptr_t)snap_node(w, node->condition);
+    copy.body = (ASTNode*)(uintptr_t)snap_node(w, node->body);
+    copy.else_body = (ASTNode*)(uintptr_t)snap_node(w, node->else_body);
+    copy.params = (ASTNode*)(uintptr_t)snap_node(w, node->params);
+    copy.next_param = (ASTNode*)(uintptr_t)snap_node(w, node->next_param);
+    copy.index = (ASTNode*)(uintptr_t)snap_node(w, node->index);
+    w->nodes[idx] = copy;
+    return (uint32_t)idx + 1;
+}
+
+// Writes the map a value refers to, then the maps inside it, once each
+static void snap_map(SnapWriter* w, Buffer* maps, Map* seen, const char* value, uint64_t* count) {
+    Map* map = map_from_value(value);
+    if (!map || map_get(seen, value)) return;
+    map_set(seen, value, "");
+    SnapMap sm = {map->id, (uint32_t)map->count};
+    buf_write(maps, &sm, sizeof(sm));
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (!map->slots[i].dist) continue;
+        uint32_t pair[2] = {snap_string(w, map->slots[i].key), snap_string(w, map->slots[i].value)};
+        buf_write(maps, pair, sizeof(pair));
+    }
+    (*count)++;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].dist) snap_map(w, maps, seen, map->slots[i].value, count);
+    }
+}
+
+bool snapshot_save(const char* path) {
+    SnapWriter w = {{NULL, 0, 0}, map_new(), 0, NULL, 0, 0};
+    Buffer funcs = {NULL, 0, 0};
+    Buffer maps = {NULL, 0, 0};
+    Buffer syms = {NULL, 0, 0};
+    Map* seen = map_new();
+    SnapHeader h;
+    memset(&h, 0, sizeof(h));
+
+    for (Function* f = function_table; f; f = f->next) {
+        SnapFunction sf = {snap_string(&w, f->name), snap_node(&w, f->params),
+                           snap_node(&w, f->body), f->memo ? (uint32_t)f->memo->line + 1 : 0};
+        buf_write(&funcs, &sf, sizeof(sf));
+        h.func_count++;
+    }
+    for (Symbol* s = symbol_table; s; s = s->next) {
+        SnapSymbol ss = {snap_string(&w, s->name), snap_string(&w, s->value),
+                         s->type, s->is_constant ? SNAP_SYM_CONST : 0};
+        buf_write(&syms, &ss, sizeof(ss));
+        snap_map(&w, &maps, seen, s->value, &h.map_count);
+        h.sym_count++;
+    }
+
+    Buffer out = {NULL, 0, 0};
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h.version = SNAPSHOT_VERSION;
+    h.node_size = sizeof(ASTNode);
+    h.string_count = w.string_count;
+    h.node_count = w.node_count;
+    buf_write(&out, &h, sizeof(h));
+    buf_align(&out);
+    h.strings_offset = out.len;
+    buf_write(&out, w.strings.data, w.strings.len);
+    buf_align(&out);
+    h.nodes_offset = out.len;
+    buf_write(&out, w.nodes, w.node_count * sizeof(ASTNode));
+    buf_align(&out);
+    h.funcs_offset = out.len;
+    buf_write(&out, funcs.data, funcs.len);
+    buf_align(&out);
+    h.maps_offset = out.len;
+    buf_write(&out, maps.data, maps.len);
+    buf_align(&out);
+    h.syms_offset = out.len;
+    buf_write(&out, syms.data, syms.len);
+    h.total_size = out.len;
+    memcpy(out.data, &h, sizeof(h));
+
+    bool ok = false;
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        ok = fwrite(out.data, 1, out.len, file) == out.len;
+        fclose(file);
+    }
+    if (!ok) fprintf(stderr, "Error: No se pudo escribir la imagen '%s'\n", path);
+
+    map_free(w.string_ids);
+    map_free(seen);
+    free(w.strings.data);
+    free(w.nodes);
+    free(funcs.data);
+    free(maps.data);
+    free(syms.data);
+    free(out.data);
+    return ok;
+}
+
+// The image stays mapped for the rest of the process: restored functions
+// execute the ASTNode structs inside it directly.
+static char* snapshot_map(const char* path, size_t* size) {
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(*size);
+    if (data && fread(data, 1, *size, file) != *size) { free(data); data = NULL; }
+    fclose(file);
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    char* data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = (size_t)st.st_size;
+        data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) data = NULL;
+    }
+    close(fd);
+    return data;
+#endif
+}
+
+static void snapshot_unmap(char* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    free(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+// True if count items of item_size fit between offset and limit
+static bool snap_fits(uint64_t offset, uint64_t count, size_t item_size, uint64_t limit) {
+    return offset <= limit && offset % 8 == 0 && count <= (limit - offset) / item_size;
+}
+
+// Every section lies inside the image in write order, and every string,
+// node and map index points inside its table; nothing is relocated before
+// the whole image has been checked.
+static bool snapshot_valid(const char* base, size_t size, const char** strings) {
+    const SnapHeader* h = (const SnapHeader*)base;
+    if (size < sizeof(SnapHeader) || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        h->version != SNAPSHOT_VERSION || h->node_size != sizeof(ASTNode) || h->total_size != size) return false;
+    if (h->strings_offset < sizeof(SnapHeader) || h->strings_offset > h->nodes_offset ||
+        !snap_fits(h->nodes_offset, h->node_count, sizeof(ASTNode), h->funcs_offset) ||
+        !snap_fits(h->funcs_offset, h->func_count, sizeof(SnapFunction), h->maps_offset) ||
+        h->maps_offset > h->syms_offset ||
+        !snap_fits(h->syms_offset, h->sym_count, sizeof(SnapSymbol), size)) return false;
+
+    const char* p = base + h->strings_offset;
+    const char* end = base + h->nodes_offset;
+    for (uint64_t i = 1; i <= h->string_count; i++) {
+        uint32_t len;
+        if ((size_t)(end - p) < sizeof(len)) return false;
+        memcpy(&len, p, sizeof(len));
+        if ((size_t)(end - p) - sizeof(len) <= len || p[sizeof(len) + len] != '\0') return false;
+        strings[i] = p + sizeof(len);
+        p += sizeof(len) + len + 1;
+    }
+
+    // Nodes are written in pre-order, so a child always comes after its
+    // parent; anything else could close a cycle
+#define SNAP_NODE_OK(field) (!n->field || ((uintptr_t)n->field > i + 1 && (uintptr_t)n->field <= h->node_count))
+    const ASTNode* nodes = (const ASTNode*)(base + h->nodes_offset);
+    for (uint64_t i = 0; i < h->node_count; i++) {
+        const ASTNode* n = &nodes[i];
+        if ((unsigned)n->type >= NODE_TYPE_COUNT || (uintptr_t)n->value > h->string_count ||
+            (uintptr_t)n->var_name > h->string_count || !SNAP_NODE_OK(left) || !SNAP_NODE_OK(right) ||
+            !SNAP_NODE_OK(condition) || !SNAP_NODE_OK(body) || !SNAP_NODE_OK(else_body) ||
+            !SNAP_NODE_OK(params) || !SNAP_NODE_OK(next_param) || !SNAP_NODE_OK(index)) return false;
+    }
+#undef SNAP_NODE_OK
+
+    const SnapFunction* sf = (const SnapFunction*)(base + h->funcs_offset);
+    for (uint64_t i = 0; i < h->func_count; i++) {
+        if (!sf[i].name || sf[i].name > h->string_count || sf[i].params > h->node_count ||
+            sf[i].body > h->node_count) return false;
+    }
+
+    p = base + h->maps_offset;
+    end = base + h->syms_offset;
+    for (uint64_t i = 0; i < h->map_count; i++) {
+        SnapMap sm;
+        if ((size_t)(end - p) < sizeof(sm)) return false;
+        memcpy(&sm, p, sizeof(sm));
+        p += sizeof(sm);
+        if (sm.count > (size_t)(end - p) / (2 * sizeof(uint32_t))) return false;
+        for (uint32_t j = 0; j < sm.count; j++) {
+            uint32_t pair[2];
+            memcpy(pair, p, sizeof(pair));
+            p += sizeof(pair);
+            if (pair[0] > h->string_count || pair[1] > h->string_count) return false;
+        }
+    }
+
+    const SnapSymbol* ss = (const SnapSymbol*)(base + h->syms_offset);
+    for (uint64_t i = 0; i < h->sym_count; i++) {
+        if (!ss[i].name || ss[i].name > h->string_count || ss[i].value > h->string_count ||
+            ss[i].type > TYPE_UNKNOWN) return false;
+    }
+    return true;
+}
+
+// New handle for a saved handle value, NULL for any other value
+static const char* snap_moved(Map* remap, const char* value) {
+    uint32_t id = map_handle_id(value);
+    if (!id) return NULL;
+    char old[16];
+    snprintf(old, sizeof(old), "%u", id);
+    return map_get(remap, old);
+}
+
+bool snapshot_load(const char* path) {
+    size_t size = 0;
+    char* base = snapshot_map(path, &size);
+    SnapHeader* h = (SnapHeader*)base;
+    // Bounded by the image size before anything is allocated from it
+    uint64_t string_limit = base && size >= sizeof(SnapHeader) ? size / (sizeof(uint32_t) + 1) : 0;
+    const char** strings = NULL;
+    if (base && size >= sizeof(SnapHeader) && h->string_count <= string_limit) {
+        strings = calloc(h->string_count + 1, sizeof(char*));
+    }
+    if (!strings || !snapshot_valid(base, size, strings)) {
+        fprintf(stderr, "Error: Imagen no válida '%s'\n", path);
+        free(strings);
+        if (base) snapshot_unmap(base, size);
+        return false;
+    }
+
+    // Strings are re-interned so names stay pointer-equal to the ones the
+    // main script produces
+    for (uint64_t i = 1; i <= h->string_count; i++) {
+        uint32_t len;
+        memcpy(&len, strings[i] - sizeof(len), sizeof(len));
+        strings[i] = intern(strings[i], len);
+    }
+
+    ASTNode* nodes = (ASTNode*)(base + h->nodes_offset);
+#define RELOC_NODE(field) n->field = n->field ? &nodes[(uintptr_t)n->field - 1] : NULL
+    for (uint64_t i = 0; i < h->node_count; i++) {
+        ASTNode* n = &nodes[i];
+        n->value = strings[(uintptr_t)n->value];
+        n->var_name = strings[(uintptr_t)n->var_name];
+        RELOC_NODE(left);
+        RELOC_NODE(right);
+        RELOC_NODE(condition);
+        RELOC_NODE(body);
+        RELOC_NODE(else_body);
+        RELOC_NODE(params);
+        RELOC_NODE(next_param);
+        RELOC_NODE(index);
+    }
+#undef RELOC_NODE
+
+    // Tables were written head first; rebuild them in the same order
+    SnapFunction* sf = (SnapFunction*)(base + h->funcs_offset);
+    Function** tail = &function_table;
+    while (*tail) tail = &(*tail)->next;
+    for (uint64_t i = 0; i < h->func_count; i++) {
+        Function* f = malloc(sizeof(Function));
+        f->name = strings[sf[i].name];
+        f->params = sf[i].params ? &nodes[sf[i].params - 1] : NULL;
+        f->body = sf[i].body ? &nodes[sf[i].body - 1] : NULL;
+        f->memo = sf[i].memo ? memo_new(STOW_MEMO_CAPACITY) : NULL;
+        if (f->memo) f->memo->line = (int)sf[i].memo - 1;
+        f->next = NULL;
+        *tail = f;
+        tail = &f->next;
+    }
+    function_generation++;
+
+    // Maps first, so the handles in map values and symbols can be rewritten;
+    // remap goes from the saved id to the new handle
+    Map* remap = map_new();
+    char* q = base + h->maps_offset;
+    for (uint64_t i = 0; i < h->map_count; i++) {
+        SnapMap sm;
+        memcpy(&sm, q, sizeof(sm));
+        q += sizeof(sm) + sm.count * 2 * sizeof(uint32_t);
+        char old[16];
+        snprintf(old, sizeof(old), "%u", sm.id);
+        char* handle = map_handle(map_create());
+        map_set(remap, old, handle);
+        free(handle);
+    }
+    q = base + h->maps_offset;
+    for (uint64_t i = 0; i < h->map_count; i++) {
+        SnapMap sm;
+        memcpy(&sm, q, sizeof(sm));
+        q += sizeof(sm);
+        char old[16];
+        snprintf(old, sizeof(old), "%u", sm.id);
+        Map* map = map_from_value(map_get(remap, old));
+        for (uint32_t j = 0; j < sm.count; j++) {
+            uint32_t pair[2];
+            memcpy(pair, q, sizeof(pair));
+            q += sizeof(pair);
+            const char* value = strings[pair[1]] ? strings[pair[1]] : "";
+            const char* moved = snap_moved(remap, value);
+            map_set(map, strings[pair[0]] ? strings[pair[0]] : "", moved ? moved : value);
+        }
+    }
+
+    // The image loads before any script runs, so the symbols are appended
+    // in their saved order without looking each name up
+    q = base + h->syms_offset;
+    Symbol** sym_tail = &symbol_table;
+    while (*sym_tail) sym_tail = &(*sym_tail)->next;
+    for (uint64_t i = 0; i < h->sym_count; i++) {
+        SnapSymbol ss;
+        memcpy(&ss, q, sizeof(ss));
+        q += sizeof(ss);
+        const char* value = strings[ss.value] ? strings[ss.value] : "";
+        const char* moved = snap_moved(remap, value);
+        Symbol* sym = malloc(sizeof(Symbol));
+        sym->name = strings[ss.name];
+        sym->type = (DataType)ss.type;
+        sym->value = strdup(moved ? moved : value);
+        sym->capacity = strlen(sym->value) + 1;
+        heap_in_use += sym->capacity;
+        sym->is_constant = ss.flags & SNAP_SYM_CONST;
+        sym->next = NULL;
+        *sym_tail = sym;
+        sym_tail = &sym->next;
+    }
+
+    map_free(remap);
+    free(strings);
+    return true;
+}
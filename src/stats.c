@@ -0,0 +1,113 @@
+#define STOW_STATS_IMPL
+#include "stow.h"
+
+#ifdef STOW_STATS
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+Stats stats;
+
+// Every block carries its size in a header so free() can account bytes
+#define STATS_HEADER 16
+
+void* stats_malloc(size_t size) {
+    unsigned char* p = malloc(size + STATS_HEADER);
+    if (!p) return NULL;
+    *(size_t*)p = size;
+    stats.mallocs++;
+    stats.bytes_allocated += size;
+    stats.bytes_live += size;
+    if (stats.bytes_live > stats.bytes_peak) stats.bytes_peak = stats.bytes_live;
+    return p + STATS_HEADER;
+}
+
+void* stats_calloc(size_t count, size_t size) {
+    void* p = stats_malloc(count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+void stats_free(void* ptr) {
+    if (!ptr) return;
+    unsigned char* p = (unsigned char*)ptr - STATS_HEADER;
+    stats.frees++;
+    stats.bytes_freed += *(size_t*)p;
+    stats.bytes_live -= *(size_t*)p;
+    free(p);
+}
+
+void* stats_realloc(void* ptr, size_t size) {
+    if (!ptr) return stats_malloc(size);
+    size_t old = *(size_t*)((unsigned char*)ptr - STATS_HEADER);
+    void* p = stats_malloc(size);
+    if (!p) return NULL;
+    memcpy(p, ptr, old < size ? old : size);
+    stats_free(ptr);
+    return p;
+}
+
+char* stats_strdup(const char* s) {
+    size_t len = strlen(s) + 1;
+    char* p = stats_malloc(len);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+static long stats_peak_rss_kb(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return ru.ru_maxrss;
+#endif
+}
+
+static const char* node_type_names[NODE_TYPE_COUNT] = {
+    "print", "input", "string", "number", "identifier",
+    "var_decl", "block", "func_decl", "func_call",
+    "if", "while", "bin_op", "list", "param", "assign",
+    "return", "break", "continue", "import", "index", "map", "pair", "for", "spawn"
+};
+
+static double stats_avg(unsigned long steps, unsigned long lookups) {
+    return lookups ? (double)steps / lookups : 0.0;
+}
+
+void stats_report(FILE* out) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"time_ms\": {\"parse\": %.3f, \"run\": %.3f},\n", stats.parse_ms, stats.run_ms);
+    fprintf(out, "  \"memory\": {\"mallocs\": %lu, \"frees\": %lu, \"bytes_allocated\": %lu, "
+                 "\"bytes_freed\": %lu, \"bytes_peak\": %lu, \"peak_rss_kb\": %ld},\n",
+            stats.mallocs, stats.frees, stats.bytes_allocated,
+            stats.bytes_freed, stats.bytes_peak, stats_peak_rss_kb());
+    fprintf(out, "  \"tokens\": %lu,\n", stats.tokens);
+    fprintf(out, "  \"ast_nodes\": %lu,\n", stats.ast_nodes);
+    fprintf(out, "  \"symbol_lookups\": {\"count\": %lu, \"avg_chain\": %.2f},\n",
+            stats.symbol_lookups, stats_avg(stats.symbol_steps, stats.symbol_lookups));
+    fprintf(out, "  \"function_lookups\": {\"count\": %lu, \"avg_chain\": %.2f},\n",
+            stats.function_lookups, stats_avg(stats.function_steps, stats.function_lookups));
+
+    unsigned long hits = 0, misses = 0, evictions = 0;
+    for (Function* f = function_table; f; f = f->next) {
+        if (!f->memo) continue;
+        hits += f->memo->hits;
+        misses += f->memo->misses;
+        evictions += f->memo->evictions;
+    }
+    fprintf(out, "  \"memo\": {\"hits\": %lu, \"misses\": %lu, \"evictions\": %lu},\n",
+            hits, misses, evictions);
+
+    fprintf(out, "  \"node_evals\": {");
+    bool first = true;
+    for (int i = 0; i < NODE_TYPE_COUNT; i++) {
+        if (!stats.node_evals[i]) continue;
+        fprintf(out, "%s\"%s\": %lu", first ? "" : ", ", node_type_names[i], stats.node_evals[i]);
+        first = false;
+    }
+    fprintf(out, "}\n}\n");
+}
+
+#endif
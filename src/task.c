@@ -0,0 +1,441 @@
+#include "stow.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+// Green tasks for `spawn`, switched cooperatively on the one interpreter
+// thread: a task gives up the CPU when it blocks on a channel, waits for
+// input, or its time slice ends at a BUDGET_TICK (see budget.c).
+//
+// Each task gets its own native stack, reserved for max_call_depth calls
+// but committed page by page as it grows. How much one call level takes
+// depends on how deeply its statements nest, so calls also check the
+// room left (task_stack_low) and report E014 before running out. Globals are shared; parameters
+// and locals live in the task's own bindings (Task.locals), so a switch
+// only changes current_task.
+//
+// Only `input` waits without holding the CPU. import and the other file
+// reads are synchronous and stall every task until they finish.
+
+// Reserved native stack per Stow call level; pages are only committed
+// when touched
+#define TASK_FRAME_BYTES 8192
+// Room kept below the last checked call for its own C frames and natives
+#define TASK_STACK_RESERVE (16 * TASK_FRAME_BYTES)
+
+typedef struct {
+    Task* head;
+    Task* tail;
+} TaskQueue;
+
+static Task main_task;
+Task* current_task = &main_task;
+int task_count = 0;
+static TaskQueue run_queue = {NULL, NULL};
+static Task* dead_tasks = NULL;
+static Task* all_tasks = NULL;
+
+// Typed bounded channel; handles are "chan#N" strings
+typedef struct {
+    DataType type;
+    char** items; // ring buffer
+    int cap;
+    int head;
+    int count;
+    TaskQueue senders;
+    TaskQueue receivers;
+} Channel;
+
+static Channel** channels = NULL;
+static int channel_count = 0;
+static int channel_capacity = 0;
+
+static void queue_push(TaskQueue* q, Task* t) {
+    t->next = NULL;
+    if (q->tail) q->tail->next = t; else q->head = t;
+    q->tail = t;
+}
+
+static Task* queue_pop(TaskQueue* q) {
+    Task* t = q->head;
+    if (!t) return NULL;
+    q->head = t->next;
+    if (!q->head) q->tail = NULL;
+    t->next = NULL;
+    return t;
+}
+
+static void task_wake(Task* t) {
+    t->state = TASK_RUNNABLE;
+    queue_push(&run_queue, t);
+}
+
+static void task_free(Task* t) {
+    if (t->all_prev) t->all_prev->all_next = t->all_next; else all_tasks = t->all_next;
+    if (t->all_next) t->all_next->all_prev = t->all_prev;
+#ifdef _WIN32
+    DeleteFiber(t->context);
+#else
+    munmap(t->stack, t->stack_size);
+    free(t->context);
+#endif
+    free(t->call_stack);
+    free(t->temps);
+    free(t);
+}
+
+// Finished tasks are freed from another task, once off their stack
+static void task_reap(void) {
+    while (dead_tasks) {
+        Task* t = dead_tasks;
+        dead_tasks = t->next;
+        task_free(t);
+    }
+}
+
+// Nothing can run: every live task waits on a channel. The abort wakes
+// them all so they unwind.
+static void task_deadlock(void) {
+    int line = 0;
+    for (int i = 0; i < channel_count && !line; i++) {
+        if (channels[i]->senders.head) line = channels[i]->senders.head->line;
+        else if (channels[i]->receivers.head) line = channels[i]->receivers.head->line;
+    }
+    runtime_abort("E020", line);
+    for (int i = 0; i < channel_count; i++) {
+        Task* t;
+        while ((t = queue_pop(&channels[i]->senders))) task_wake(t);
+        while ((t = queue_pop(&channels[i]->receivers))) task_wake(t);
+    }
+}
+
+// Runs the next runnable task; the caller has already queued, blocked or
+// finished the current one
+static void task_switch(void) {
+    Task* prev = current_task;
+    Task* next = queue_pop(&run_queue);
+    if (!next) {
+        task_deadlock();
+        next = queue_pop(&run_queue);
+    }
+    if (!next || next == prev) {
+        prev->state = TASK_RUNNABLE;
+        return;
+    }
+    current_task = next;
+#ifdef _WIN32
+    SwitchToFiber(next->context);
+#else
+    swapcontext(prev->context, next->context);
+#endif
+    task_reap();
+}
+
+static void task_entry(void) {
+    Task* t = current_task;
+    task_reap();
+    char** args = t->args;
+    t->args = NULL; // call_with_args holds them until they are bound
+    free(call_with_args(t->entry, args, t->argc, t->line));
+    t->state = TASK_DONE;
+    task_count--;
+    t->next = dead_tasks;
+    dead_tasks = t;
+    task_switch();
+}
+
+#ifdef _WIN32
+static void WINAPI task_fiber(void* arg) {
+    (void)arg;
+    char top;
+    current_task->stack_limit = task_stack_limit(&top, current_task->stack_size);
+    task_entry();
+}
+#endif
+
+static size_t task_stack_bytes(void) {
+    return (size_t)(max_call_depth > 64 ? max_call_depth : 64) * TASK_FRAME_BYTES;
+}
+
+// Limit for a stack of size bytes whose top is near top
+static char* task_stack_limit(char* top, size_t size) {
+    if (size <= TASK_STACK_RESERVE || (uintptr_t)top < size) return NULL;
+    return (char*)((uintptr_t)top - size + TASK_STACK_RESERVE);
+}
+
+bool task_stack_low(void) {
+    char here;
+    char* limit = current_task->stack_limit;
+    return limit && (uintptr_t)&here < (uintptr_t)limit;
+}
+
+#ifndef _WIN32
+// Reserves size bytes plus a guard page; returns the usable base or NULL
+static char* task_stack_map(size_t size, void** mapping, size_t* mapping_size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *mapping_size = size + page;
+    *mapping = mmap(NULL, *mapping_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (*mapping == MAP_FAILED) return NULL;
+    mprotect(*mapping, page, PROT_NONE); // guard page below the stack
+    return (char*)*mapping + page;
+}
+#endif
+
+void task_spawn(Function* f, char** args, int argc, int line) {
+    Task* t = calloc(1, sizeof(Task));
+    t->entry = f;
+    t->args = args;
+    t->argc = argc;
+    t->line = line;
+    t->state = TASK_RUNNABLE;
+    size_t stack = task_stack_bytes();
+#ifdef _WIN32
+    if (!main_task.context) main_task.context = ConvertThreadToFiber(NULL);
+    t->stack_size = stack;
+    t->context = CreateFiberEx(0, stack, 0, task_fiber, NULL);
+    if (!t->context) {
+        runtime_abort("E024", line);
+        free_args(args, argc);
+        free(t);
+        return;
+    }
+#else
+    static ucontext_t main_context;
+    main_task.context = &main_context;
+    char* base = task_stack_map(stack, &t->stack, &t->stack_size);
+    if (!base) {
+        runtime_abort("E024", line);
+        free_args(args, argc);
+        free(t);
+        return;
+    }
+    ucontext_t* ctx = malloc(sizeof(ucontext_t));
+    getcontext(ctx);
+    ctx->uc_stack.ss_sp = base;
+    ctx->uc_stack.ss_size = stack;
+    ctx->uc_link = NULL;
+    makecontext(ctx, task_entry, 0);
+    t->context = ctx;
+    t->stack_limit = base + TASK_STACK_RESERVE;
+#endif
+    task_count++;
+    t->all_next = all_tasks;
+    if (all_tasks) all_tasks->all_prev = t;
+    all_tasks = t;
+    queue_push(&run_queue, t);
+    budget_reschedule();
+}
+
+#ifdef _WIN32
+static void (*main_fn)(void);
+static void* main_thread_fiber;
+
+static void WINAPI task_main_fiber(void* arg) {
+    (void)arg;
+    char top;
+    main_task.stack_limit = task_stack_limit(&top, main_task.stack_size);
+    main_fn();
+    SwitchToFiber(main_thread_fiber);
+}
+#endif
+
+// Non-tail calls nest C frames. When max_call_depth needs more than the
+// process stack gives, the main script runs on a stack reserved like a
+// task's; either way its stack_limit turns running out into E014.
+void task_run_main(void (*fn)(void)) {
+    size_t stack = task_stack_bytes();
+#ifdef _WIN32
+    // The size of the thread's own stack is not known; run on a fiber's
+    main_fn = fn;
+    main_thread_fiber = ConvertThreadToFiber(NULL);
+    if (!main_thread_fiber) { fn(); return; }
+    main_task.stack_size = stack;
+    main_task.context = CreateFiberEx(0, stack, 0, task_main_fiber, NULL);
+    if (!main_task.context) { ConvertFiberToThread(); fn(); return; }
+    SwitchToFiber(main_task.context);
+    DeleteFiber(main_task.context);
+    main_task.context = NULL;
+    main_task.stack_limit = NULL;
+    ConvertFiberToThread();
+#else
+    struct rlimit rl;
+    char top;
+    bool limited = getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY;
+    if (limited) main_task.stack_limit = task_stack_limit(&top, rl.rlim_cur);
+    if (!limited || rl.rlim_cur >= stack) {
+        fn();
+        return;
+    }
+    void* mapping;
+    size_t mapping_size;
+    char* base = task_stack_map(stack, &mapping, &mapping_size);
+    if (!base) { fn(); return; }
+    main_task.stack_limit = base + TASK_STACK_RESERVE;
+    ucontext_t back, ctx;
+    getcontext(&ctx);
+    ctx.uc_stack.ss_sp = base;
+    ctx.uc_stack.ss_size = stack;
+    ctx.uc_link = &back;
+    makecontext(&ctx, fn, 0);
+    swapcontext(&back, &ctx);
+    main_task.stack_limit = NULL;
+    munmap(mapping, mapping_size);
+#endif
+}
+
+void task_yield(void) {
+    if (!run_queue.head) return;
+    queue_push(&run_queue, current_task);
+    task_switch();
+}
+
+// The caller has put the current task on a channel's wait queue
+void task_block(int line) {
+    current_task->state = TASK_BLOCKED;
+    current_task->line = line;
+    task_switch();
+}
+
+// `input` lets the other tasks run until stdin has data
+void task_wait_input(void) {
+#ifndef _WIN32
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    fflush(stdout);
+    while (run_queue.head && !should_abort && poll(&pfd, 1, 0) == 0) task_yield();
+#endif
+}
+
+// Runs the spawned tasks to completion from the main task
+void task_wait_all(void) {
+    while (task_count > 0) {
+        if (!run_queue.head) task_deadlock();
+        task_yield();
+    }
+    task_reap();
+    should_abort = false;
+}
+
+static Channel* chan_lookup(const char* handle, int line) {
+    int n = 0, end = 0;
+    if (sscanf(handle, "chan#%d%n", &n, &end) != 1 || handle[end] || n < 1 || n > channel_count) {
+        runtime_abort("E021", line);
+        return NULL;
+    }
+    return channels[n - 1];
+}
+
+static bool chan_accepts(Channel* ch, const char* value) {
+    double v;
+    switch (ch->type) {
+        case TYPE_INT: return parse_number(value, &v) && v == (long long)v;
+        case TYPE_FLOAT: return parse_number(value, &v);
+        case TYPE_BOOL: return strcmp(value, "true") == 0 || strcmp(value, "false") == 0;
+        case TYPE_MAP: return map_from_value(value) != NULL;
+        default: return true;
+    }
+}
+
+// chan(capacidad, "Tipo"); a capacity below 1 is taken as 1
+static char* native_chan(NativeArg* args) {
+    DataType type = intern_type(intern_cstr(args[1].str));
+    if (type == TYPE_UNKNOWN) {
+        runtime_abort("E006", native_line);
+        return strdup("");
+    }
+    Channel* ch = calloc(1, sizeof(Channel));
+    ch->type = type;
+    ch->cap = args[0].num >= 1 ? (int)args[0].num : 1;
+    ch->items = malloc(ch->cap * sizeof(char*));
+    if (channel_count == channel_capacity) {
+        channel_capacity = channel_capacity ? channel_capacity * 2 : 8;
+        channels = realloc(channels, channel_capacity * sizeof(Channel*));
+    }
+    channels[channel_count++] = ch;
+    char* handle = malloc(32);
+    snprintf(handle, 32, "chan#%d", channel_count);
+    return handle;
+}
+
+static char* native_send(NativeArg* args) {
+    int line = native_line;
+    Channel* ch = chan_lookup(args[0].str, line);
+    if (!ch) return strdup("");
+    if (!chan_accepts(ch, args[1].str)) {
+        runtime_abort("E019", line);
+        return strdup("");
+    }
+    while (ch->count == ch->cap && !should_abort) {
+        queue_push(&ch->senders, current_task);
+        task_block(line);
+    }
+    if (should_abort) return strdup("");
+    size_t len = strlen(args[1].str) + 1;
+    ch->items[(ch->head + ch->count) % ch->cap] = strdup(args[1].str);
+    ch->count++;
+    heap_in_use += len;
+    if (ch->receivers.head) task_wake(queue_pop(&ch->receivers));
+    return strdup("void");
+}
+
+static char* native_recv(NativeArg* args) {
+    int line = native_line;
+    Channel* ch = chan_lookup(args[0].str, line);
+    if (!ch) return strdup("");
+    while (ch->count == 0 && !should_abort) {
+        queue_push(&ch->receivers, current_task);
+        task_block(line);
+    }
+    if (should_abort) return strdup("");
+    char* value = ch->items[ch->head];
+    ch->head = (ch->head + 1) % ch->cap;
+    ch->count--;
+    heap_in_use -= strlen(value) + 1;
+    if (ch->senders.head) task_wake(queue_pop(&ch->senders));
+    return value;
+}
+
+static char* native_yield(NativeArg* args) {
+    (void)args;
+    task_yield();
+    return strdup("void");
+}
+
+static void task_mark(Task* t) {
+    for (Symbol* s = t->locals; s; s = s->next) map_mark(s->value);
+    for (int i = 0; i < t->call_depth; i++) {
+        CallFrame* frame = &t->call_stack[i];
+        for (int j = 0; j < frame->saved_count; j++) {
+            if (frame->saved[j].value) map_mark(frame->saved[j].value);
+        }
+    }
+    for (int i = 0; t->args && i < t->argc; i++) map_mark(t->args[i]);
+    for (int i = 0; t->tail_args && i < t->tail_argc; i++) map_mark(t->tail_args[i]);
+    if (t->return_value) map_mark(t->return_value);
+    for (int i = 0; i < t->temp_count; i++) map_mark(t->temps[i]);
+}
+
+// Every task's bindings, pending arguments and temporaries, and buffered
+// channel values keep the maps they refer to alive
+void task_mark_maps(void) {
+    task_mark(&main_task);
+    for (Task* t = all_tasks; t; t = t->all_next) task_mark(t);
+    for (int i = 0; i < channel_count; i++) {
+        Channel* ch = channels[i];
+        for (int j = 0; j < ch->count; j++) map_mark(ch->items[(ch->head + j) % ch->cap]);
+    }
+}
+
+void task_register_natives(void) {
+    register_native("chan", "ns", false, native_chan);
+    register_native("send", "ss", false, native_send);
+    register_native("recv", "s", false, native_recv);
+    register_native("yield", "", false, native_yield);
+}
@@ -0,0 +1,10 @@
+# Temporary maps are freed at any call depth and while tasks run, and
+# their slots are reused: creating 100 times more maps does not grow the
+# peak memory
+peak() {
+    echo "$1" | $STOW_STATS --stats tests/lib/mapas_temporales.stow 2>&1 >/dev/null |
+        sed -n 's/.*"bytes_peak": \([0-9]*\).*/\1/p'
+}
+small=$(peak 2000)
+large=$(peak 200000)
+[ -n "$small" ] && [ "$large" -lt $((small * 2)) ]
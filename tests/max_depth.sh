@@ -0,0 +1,5 @@
+# When the stack for --max-depth can not be reserved, the script runs on
+# the process stack and running out of it is still E014, not a crash
+out=$( (ulimit -s 8192 && ulimit -v 400000 &&
+        $STOW --max-depth 100000000 tests/max_depth.stow) 2>&1)
+[ $? -lt 128 ] && echo "$out" | grep -q E014
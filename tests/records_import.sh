@@ -0,0 +1,7 @@
+# The import runs once: parsing 1 or 500 records reads the same tokens
+counters() {
+    awk -v n="$1" 'BEGIN { for (i = 0; i < n; i++) print "x" }' |
+        $STOW_STATS -n --stats tests/records_import.stow 2>&1 >/dev/null |
+        grep -E '"(tokens|ast_nodes)"'
+}
+[ "$(counters 1)" = "$(counters 500)" ]
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Usage: tests/run.sh ./stow ./stow-stats
+#
+# Each tests/NAME.stow runs with the flags on its `// args:` line and
+# tests/NAME.in (if any) on stdin; stdout and stderr must match
+# tests/NAME.out. Each tests/NAME.sh runs with $STOW and $STOW_STATS set
+# and passes if it exits 0.
+
+STOW=${1:-./stow}
+STOW_STATS=${2:-./stow-stats}
+export STOW STOW_STATS
+failed=0
+
+for t in tests/*.stow; do
+    name=${t%.stow}
+    args=$(sed -n 's|^// args: ||p' "$t" | head -n 1)
+    input=/dev/null
+    [ -f "$name.in" ] && input="$name.in"
+    if ! $STOW $args "$t" < "$input" 2>&1 | diff -u "$name.out" - > /dev/null; then
+        echo "FALLO: $t"
+        $STOW $args "$t" < "$input" 2>&1 | diff -u "$name.out" -
+        failed=1
+    fi
+done
+
+for t in tests/*.sh; do
+    [ "$t" = tests/run.sh ] && continue
+    if ! sh "$t"; then
+        echo "FALLO: $t"
+        failed=1
+    fi
+done
+
+[ $failed = 0 ] && echo "Todas las pruebas pasaron"
+exit $failed
@@ -0,0 +1,20 @@
+# A saved image loads. The same image with a node's `left` pointing back
+# at the node itself is rejected instead of recursing forever.
+# Assumes the 64-bit little-endian ASTNode layout (`left` at byte 40).
+img=${TMPDIR:-/tmp}/stow_ciclo_$$.img
+trap 'rm -f "$img" "$img.stow"' EXIT
+$STOW --snapshot "$img" tests/lib/preludio.stow > /dev/null || exit 1
+echo 'print(doble(BASE));' > "$img.stow"
+[ "$($STOW --from-snapshot "$img" "$img.stow")" = 40 ] || exit 1
+
+u8() { od -A n -t u8 -j "$1" -N 8 "$img" | tr -d ' '; }
+node_size=$(od -A n -t u4 -j 12 -N 4 "$img" | tr -d ' ')
+node_count=$(u8 32)
+nodes=$(u8 40)
+i=0
+while [ $i -lt "$node_count" ] && [ "$(u8 $((nodes + i * node_size + 40)))" = 0 ]; do i=$((i + 1)); done
+[ $i -lt "$node_count" ] || exit 1
+printf "\\$(printf '%03o' $((i + 1)))\\000\\000\\000\\000\\000\\000\\000" |
+    dd of="$img" bs=1 seek=$((nodes + i * node_size + 40)) conv=notrunc 2> /dev/null
+out=$(timeout 5 $STOW --from-snapshot "$img" "$img.stow" 2>&1)
+[ "$out" = "Error: Imagen no válida '$img'" ]